@@ -0,0 +1,401 @@
+#if UI_USE_ANSI
+
+#include "ansiui.hpp"
+#include "recorder.hpp"
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+using std::memcpy;
+using std::string;
+using std::to_string;
+
+
+static std::mutex terminalMutex;
+
+static termios savedTermios;
+static bool    terminalActive = false;
+static int     terminalWidth  = 80;
+static int     terminalHeight = 24;
+
+// A flash inverts the terminal until the first flush after it has been
+// visible for UIFlashMilliseconds, so every display is asked to flush.
+static std::mutex                            flashMutex;
+static bool                                  flashing = false;
+static std::chrono::steady_clock::time_point flashEnd;
+static std::vector<UIDisplay *>              displays;
+
+static const short UIColorValues[] = {
+    0, 2, 1, 3, 4, 5, 6, 7
+};
+
+
+static void writeAll(const char *data, size_t length) {
+    std::lock_guard<std::mutex> lock(terminalMutex);
+    
+    while (length) {
+        ssize_t n = write(STDOUT_FILENO, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        
+        data   += n;
+        length -= n;
+    }
+}
+
+static void writeAll(const string &data) {
+    writeAll(data.data(), data.size());
+}
+
+static void appendNumber(string &out, int n) {
+    char digits[12];
+    int  i = sizeof(digits);
+    
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    
+    out.append(digits + i, sizeof(digits) - i);
+}
+
+
+UIDisplay::UIDisplay(int x, int y, int width, int height, bool autoFlush) {
+    this->x = x;
+    this->y = y;
+    
+    if (width < 0)
+        width = terminalWidth - x;
+    if (height < 0)
+        height = terminalHeight - y;
+    
+    this->width  = width;
+    this->height = height;
+    
+    size   = width * height;
+    screen = new UIChar[size];
+    update = new UIChar[size];
+    
+    for (int i = 0; i < size; i++) {
+        screen[i] = ' ';
+        update[i] = ' ';
+    }
+    
+    this->autoFlush = !autoFlush;
+    setAutoFlush(autoFlush);
+    
+    std::lock_guard<std::mutex> lock(flashMutex);
+    displays.push_back(this);
+}
+
+UIDisplay::~UIDisplay() {
+    {
+        std::lock_guard<std::mutex> lock(flashMutex);
+        displays.erase(std::remove(displays.begin(), displays.end(), this), displays.end());
+    }
+    
+    setAutoFlush(false);
+    
+    if (autoFlushThread.joinable())
+        autoFlushThread.join();
+    
+    delete[] screen;
+    delete[] update;
+}
+
+int UIDisplay::getWidth() {
+    return width;
+}
+
+int UIDisplay::getHeight() {
+    return height;
+}
+
+void UIDisplay::putChar(int x, int y, UIChar ch) {
+    if (x >= width || y >= height)
+        throw "UIDisplay: out of bounds!";
+    
+    update[y * width + x] = ch;
+}
+
+void UIDisplay::putString(int x, int y, const char *string, UIChar attr) {
+    updateMutex.lock();
+    
+    int baseX = x;
+    while (*string) {
+        if (*string == '\n') {
+            x = baseX;
+            y++;
+        } else {
+            putChar(x, y, (unsigned char)*string | attr);
+            x++;
+        }
+        
+        string++;
+    }
+    
+    updateMutex.unlock();
+    requestFlush();
+}
+
+void UIDisplay::putString(int x, int y, std::string &string, UIChar attr) {
+    putString(x, y, string.c_str(), attr);
+}
+
+void UIDisplay::eraseLine(int y) {
+    updateMutex.lock();
+    
+    for (int x = 0; x < width; x++)
+        update[y * width + x] = ' ';
+    
+    updateMutex.unlock();
+    requestFlush();
+}
+
+void UIDisplay::copyLine(int dstY, int srcY) {
+    updateMutex.lock();
+    
+    memcpy(update + dstY * width, update + srcY * width, sizeof(UIChar) * width);
+    
+    updateMutex.unlock();
+    requestFlush();
+}
+
+void UIDisplay::compose(string &out, bool all) {
+    int    cursorX = -1;
+    int    cursorY = -1;
+    UIChar attr    = ~(UIChar)0;
+    
+    if (all) {
+        out += "\x1b[?25l\x1b[0m\x1b[H\x1b[2J";
+        cursorX = this->x;
+        cursorY = this->y;
+        attr    = 0;
+    }
+    
+    const UIChar *s = screen;
+    const UIChar *u = update;
+    for (int y1 = 0; y1 < height; y1++) {
+        for (int x1 = 0; x1 < width; x1++, s++, u++) {
+            UIChar ch   = *u;
+            char   text = ch & UICharText;
+            
+            if (all ? !text || text == ' ' : *s == ch)
+                continue;
+            
+            int toX = this->x + x1;
+            int toY = this->y + y1;
+            if (toY == cursorY && cursorX >= 0 && toX > cursorX) {
+                out += "\x1b[";
+                appendNumber(out, toX - cursorX);
+                out += 'C';
+            } else if (toX != cursorX || toY != cursorY) {
+                out += "\x1b[";
+                appendNumber(out, toY + 1);
+                out += ';';
+                appendNumber(out, toX + 1);
+                out += 'H';
+            }
+            
+            UIChar color = ch & UICharColor;
+            if (color != attr) {
+                if (color) {
+                    out += "\x1b[3";
+                    out += (char)('0' + UIColorValues[(color >> 8) % (UIColorCount + 1)]);
+                    out += 'm';
+                } else
+                    out += "\x1b[0m";
+                
+                attr = color;
+            }
+            
+            out += text ? text : ' ';
+            
+            cursorX = toX + 1 < terminalWidth ? toX + 1 : -1;
+            cursorY = toY;
+        }
+    }
+}
+
+void UIDisplay::flush() {
+    updateMutex.lock();
+    
+    if (flushHandler)
+        flushHandler();
+    
+    frame.clear();
+    
+    bool flashed = false;
+    {
+        std::lock_guard<std::mutex> lock(flashMutex);
+        if (flashing && std::chrono::steady_clock::now() >= flashEnd) {
+            flashing = false;
+            frame += "\x1b[?5l";
+        } else
+            flashed = flashing;
+    }
+    
+    compose(frame, false);
+    
+    if (recorder) {
+        if (recordAll)
+            compose(recordBuffer, true);
+        else
+            recordBuffer = frame;
+        
+        recordAll = !recorder->record(recordBuffer);
+        recordBuffer.clear();
+    }
+    
+    memcpy(screen, update, size * sizeof(UIChar));
+    
+    updateMutex.unlock();
+    
+    if (frame.length())
+        writeAll(frame);
+    
+    if (flashed || (recorder && recordAll))
+        requestFlush();
+}
+
+void UIDisplay::requestFlush() {
+    if (flushPending.load(std::memory_order_relaxed) || flushPending.exchange(true))
+        return;
+    
+    std::lock_guard<std::mutex> lock(flushMutex);
+    flushReady.notify_one();
+}
+
+void UIDisplay::setAutoFlush(bool value) {
+    if (value && value != autoFlush) {
+        if (autoFlushThread.joinable())
+            autoFlushThread.join();
+        
+        autoFlush = value;
+        autoFlushThread = std::thread(&UIDisplay::flushLoop, this);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        autoFlush = value;
+    }
+    
+    flushReady.notify_one();
+}
+
+void UIDisplay::setFrameRate(int fps) {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    frameRate = fps > 0 ? fps : UIFrameRate;
+}
+
+void UIDisplay::setFlushHandler(const std::function<void()> &handler) {
+    updateMutex.lock();
+    flushHandler = handler;
+    updateMutex.unlock();
+}
+
+void UIDisplay::setRecorder(UIRecorder *recorder) {
+    updateMutex.lock();
+    this->recorder = recorder;
+    recordAll = true;
+    updateMutex.unlock();
+}
+
+void UIDisplay::flushLoop() {
+    auto last = std::chrono::steady_clock::now();
+    
+    std::unique_lock<std::mutex> lock(flushMutex);
+    while (true) {
+        flushReady.wait(lock, [this]() {
+            return flushPending || !autoFlush;
+        });
+        
+        if (!autoFlush)
+            break;
+        
+        auto next = last + std::chrono::microseconds(1000000 / frameRate);
+        lock.unlock();
+        
+        std::this_thread::sleep_until(next);
+        
+        flushPending = false;
+        flush();
+        last = std::chrono::steady_clock::now();
+        
+        lock.lock();
+    }
+}
+
+void UIInit() {
+    winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col && size.ws_row) {
+        terminalWidth  = size.ws_col;
+        terminalHeight = size.ws_row;
+    }
+    
+    if (tcgetattr(STDIN_FILENO, &savedTermios) == 0) {
+        termios raw = savedTermios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN]  = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    }
+    
+    terminalActive = true;
+    writeAll(string("\x1b[?1049h\x1b[?25l\x1b[0m\x1b[H\x1b[2J"));
+}
+
+void UIQuit() {
+    if (!terminalActive)
+        return;
+    
+    writeAll(string("\x1b[0m\x1b[?5l\x1b[?25h\x1b[?1049l"));
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedTermios);
+    terminalActive = false;
+}
+
+int UIReadKey() {
+    unsigned char key;
+    if (!UIWaitKey(0) || read(STDIN_FILENO, &key, 1) != 1)
+        return UIKeyNone;
+    
+    return key;
+}
+
+bool UIWaitKey(int timeout) {
+    pollfd input = {STDIN_FILENO, POLLIN, 0};
+    return poll(&input, 1, timeout) > 0;
+}
+
+void UIBeep() {
+    writeAll("\a", 1);
+}
+
+void UIFlash() {
+    std::lock_guard<std::mutex> lock(flashMutex);
+    if (flashing)
+        return;
+    
+    flashing = true;
+    flashEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(UIFlashMilliseconds);
+    writeAll("\x1b[?5h", 5);
+    
+    for (UIDisplay *display : displays)
+        display->requestFlush();
+}
+
+void UIAttention() {
+    UIBeep();
+    UIFlash();
+}
+
+#endif
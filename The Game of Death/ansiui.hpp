@@ -0,0 +1,126 @@
+#ifndef ANSIUI_HPP
+#define ANSIUI_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+
+typedef uint32_t UIChar;
+
+static const int UIFrameRate         = 30;
+static const int UIFlashMilliseconds = 100;
+
+static const UIChar UICharText  = 0xff;
+static const UIChar UICharColor = 0xff00;
+
+class UIRecorder;
+
+typedef enum {
+    UIColorGreen = 1,
+    UIColorRed,
+    UIColorYellow,
+    UIColorBlue,
+    UIColorMagenta,
+    UIColorCyan,
+    UIColorWhite
+} UIColor;
+static const int UIColorCount = UIColorWhite;
+
+typedef enum {
+    UIColorAttrGreen   = UIColorGreen << 8,
+    UIColorAttrRed     = UIColorRed << 8,
+    UIColorAttrYellow  = UIColorYellow << 8,
+    UIColorAttrBlue    = UIColorBlue << 8,
+    UIColorAttrMagenta = UIColorMagenta << 8,
+    UIColorAttrCyan    = UIColorCyan << 8,
+    UIColorAttrWhite   = UIColorWhite << 8
+} UIColorAttr;
+
+static inline UIColorAttr UIAttrForColor(UIColor color) {
+    return (UIColorAttr)(color << 8);
+}
+
+static inline UIColor UIColorForIndex(std::size_t index) {
+    return (UIColor)(index % UIColorCount + 1);
+}
+
+
+// Same interface as the ncurses display, but a flush composes every changed
+// square into one escape sequence buffer, switching colour only when it
+// changes and moving the cursor only across unchanged squares, and hands it
+// to the terminal with a single write().
+class UIDisplay {
+private:
+    int x;
+    int y;
+    
+    int width;
+    int height;
+    
+    int    size;
+    UIChar *screen;
+    UIChar *update;
+    
+    std::string frame;
+    void        compose(std::string &out, bool all);
+    
+    bool        autoFlush;
+    std::thread autoFlushThread;
+    void        flushLoop();
+    
+    int                     frameRate = UIFrameRate;
+    std::mutex              flushMutex;
+    std::condition_variable flushReady;
+    std::atomic<bool>       flushPending{true};
+    
+    std::function<void()> flushHandler;
+    
+    UIRecorder *recorder  = nullptr;
+    bool        recordAll = false;
+    std::string recordBuffer;
+public:
+    UIDisplay(int x, int y, int width, int height, bool autoFlush = true);
+    ~UIDisplay();
+    
+    std::mutex updateMutex;
+    
+    int  getWidth();
+    int  getHeight();
+    
+    void putChar(int x, int y, UIChar ch);
+    void putString(int x, int y, const char *string, UIChar attr = 0);
+    void putString(int x, int y, std::string &string, UIChar attr = 0);
+    
+    void eraseLine(int y);
+    void copyLine(int dstY, int srcY);
+    
+    void flush();
+    void requestFlush();
+    void setAutoFlush(bool value);
+    void setFrameRate(int fps);
+    void setFlushHandler(const std::function<void()> &handler);
+    void setRecorder(UIRecorder *recorder);
+};
+
+
+void UIInit();
+void UIQuit();
+void UIBeep();
+void UIFlash();
+void UIAttention();
+
+static const int UIKeyNone      = -1;
+static const int UIKeyEnter     = '\r';
+static const int UIKeyBackspace = 127;
+int UIReadKey();
+bool UIWaitKey(int timeout);
+
+
+#endif
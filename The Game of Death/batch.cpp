@@ -0,0 +1,98 @@
+#include "batch.hpp"
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+using std::size_t;
+using std::string;
+
+
+GameBatch::GameBatch(const GameConfig &config, size_t threads) : config(config) {
+    this->threads = std::max((size_t)1, threads);
+}
+
+void GameBatch::addRace(const string &name, GameProgramRef program) {
+    if (races.size() >= RaceCountMax)
+        throw GameException(GameErrorTooManyRaces);
+    
+    Race race;
+    race.name    = name;
+    race.program = program;
+    
+    races.push_back(race);
+}
+
+void GameBatch::recordHeatmaps(int scale) {
+    heatmaps     = true;
+    heatmapScale = scale;
+}
+
+void GameBatch::run(size_t matches, const GameBatchSeeder &seed, const GameBatchHandler &finished) {
+    std::atomic<size_t> next(0);
+    std::atomic<bool>   failed(false);
+    
+    std::mutex         mutex;
+    std::exception_ptr error;
+    
+    heatmap = GameHeatmap();
+    
+    auto play = [&]() {
+        std::unique_ptr<Game>        game;
+        std::unique_ptr<GameHeatmap> heatmap;
+        
+        try {
+            for (size_t m = next++; m < matches && !failed; m = next++) {
+                if (game)
+                    game->reset(seed(m));
+                else {
+                    GameConfig gameConfig = config;
+                    gameConfig.seed = seed(m);
+                    
+                    game.reset(new Game(gameConfig));
+                    for (Race &race : races)
+                        game->addRace(race);
+                    
+                    if (heatmaps) {
+                        heatmap.reset(new GameHeatmap(*game, heatmapScale));
+                        game->addObserver(heatmap.get());
+                    }
+                }
+                
+                while (!game->isOver() && !failed)
+                    game->step(GameBatchStride);
+                
+                if (failed)
+                    break;
+                
+                if (heatmap)
+                    heatmap->settle(*game);
+                
+                finished(m, *game);
+            }
+            
+            if (heatmap) {
+                std::lock_guard<std::mutex> lock(mutex);
+                this->heatmap.merge(*heatmap);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; i++)
+        workers.push_back(std::thread(play));
+    play();
+    
+    for (std::thread &worker : workers)
+        worker.join();
+    
+    if (error)
+        std::rethrow_exception(error);
+}
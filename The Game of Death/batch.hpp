@@ -0,0 +1,48 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include "game.hpp"
+#include "heatmap.hpp"
+
+
+static const int GameBatchStride = 1024;
+
+typedef std::function<uint64_t(std::size_t match)>         GameBatchSeeder;
+typedef std::function<void(std::size_t match, Game &game)> GameBatchHandler;
+
+// Plays many matches between the same races with different seeds on a pool
+// of threads. Each thread owns one engine sharing the decoded programs and
+// resets it with the next seed when a match ends, so engines, boards and
+// cell vectors are built once per thread rather than once per match. The
+// handler runs on the worker that played the match, concurrently with
+// other workers. With recordHeatmaps() each engine also feeds a GameHeatmap
+// that accumulates over its thread's matches; they are merged into
+// getHeatmap() when the run ends.
+class GameBatch {
+private:
+    GameConfig        config;
+    std::vector<Race> races;
+    
+    std::size_t threads;
+    
+    bool        heatmaps     = false;
+    int         heatmapScale = 0;
+    GameHeatmap heatmap;
+public:
+    GameBatch(const GameConfig &config, std::size_t threads = 1);
+    
+    void addRace(const std::string &name, GameProgramRef program);
+    void recordHeatmaps(int scale = 0);
+    
+    GameHeatmap &getHeatmap() {return heatmap;}
+    
+    void run(std::size_t matches, const GameBatchSeeder &seed, const GameBatchHandler &finished);
+};
+
+
+#endif
@@ -9,7 +9,7 @@ static const int GameInitialPopulation = 10;
 
 static const int CellCharacter = '@';
 
-static const int GameStepDelay = 0;
+static const double GameMoveRate = 0;
 
 static const int GameMoveNumber = 1000000;
 
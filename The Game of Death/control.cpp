@@ -0,0 +1,292 @@
+#include "control.hpp"
+#include <sstream>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+static const int KeyEscape = 27;
+
+static const std::chrono::milliseconds InputInterval(16);
+
+
+GameControl::GameControl(Game &game, GameView &view, double rate) : game(game), view(view), pacer(rate) {
+    updateStatus();
+}
+
+int GameControl::takeCount() {
+    int n = count.empty() ? GameControlDefaultCount : std::atoi(count.c_str());
+    count.clear();
+    
+    return n;
+}
+
+void GameControl::seek(const string &name, const std::function<bool(Game &)> &target) {
+    targetName   = name;
+    this->target = target;
+    mode         = GameControlSeeking;
+    
+    view.setSuspended(true);
+}
+
+void GameControl::stop() {
+    if (mode == GameControlSeeking) {
+        view.setSuspended(false);
+        view.redraw(game);
+    }
+    
+    mode = GameControlPaused;
+}
+
+void GameControl::setRate(double rate) {
+    pacer.setRate(rate > 0 ? rate : 0);
+}
+
+void GameControl::runCommand(const string &command) {
+    std::istringstream words(command);
+    string verb;
+    words >> verb;
+    
+    if (verb == "ff" || verb == "f") {
+        int n = GameControlDefaultCount;
+        words >> n;
+        
+        int until = game.currentMove() + n;
+        seek("move " + to_string(until), [until](Game &game) {
+            return game.currentMove() >= until;
+        });
+    } else if (verb == "move" || verb == "m") {
+        int until = 0;
+        words >> until;
+        
+        seek("move " + to_string(until), [until](Game &game) {
+            return game.currentMove() >= until;
+        });
+    } else if (verb == "ext" || verb == "x") {
+        size_t extinct = 0;
+        for (size_t i = 0; i < game.raceCount(); i++)
+            if (game.raceWithIndex(i).extinct)
+                extinct++;
+        
+        seek("next extinction", [extinct](Game &game) {
+            size_t n = 0;
+            for (size_t i = 0; i < game.raceCount(); i++)
+                if (game.raceWithIndex(i).extinct)
+                    n++;
+            
+            return n > extinct;
+        });
+    } else if (verb == "pop" || verb == "p") {
+        string which;
+        size_t below = 0;
+        words >> which >> below;
+        
+        size_t index = game.raceCount();
+        for (size_t i = 0; i < game.raceCount(); i++)
+            if (game.raceWithIndex(i).name == which)
+                index = i;
+        
+        if (index == game.raceCount() && std::isdigit((unsigned char)which[0]))
+            index = std::atoi(which.c_str()) - 1;
+        
+        if (index >= game.raceCount()) {
+            view.log("No such race: " + which);
+            return;
+        }
+        
+        seek(game.raceWithIndex(index).name + " below " + to_string(below), [index, below](Game &game) {
+            return game.raceWithIndex(index).living < below;
+        });
+    } else if (verb == "rate" || verb == "r") {
+        double rate = 0;
+        words >> rate;
+        
+        setRate(rate);
+    } else if (verb == "zoom" || verb == "z") {
+        int zoom = 0;
+        words >> zoom;
+        
+        view.setZoom(game, zoom);
+    } else if (verb == "step" || verb == "s") {
+        stop();
+        game.step();
+    } else if (verb.length())
+        view.log("Unknown command: " + command);
+}
+
+void GameControl::handleKey(int key) {
+    if (editing) {
+        if (key == '\n' || key == '\r' || key == UIKeyEnter) {
+            editing = false;
+            runCommand(command);
+        } else if (key == KeyEscape) {
+            editing = false;
+        } else if (key == UIKeyBackspace || key == 127 || key == '\b') {
+            if (command.length())
+                command.erase(command.length() - 1);
+        } else if (std::isprint(key))
+            command += (char)key;
+        
+        return;
+    }
+    
+    if (std::isdigit(key)) {
+        count += (char)key;
+        return;
+    }
+    
+    switch (key) {
+        case ' ':
+            if (mode == GameControlRunning)
+                mode = GameControlPaused;
+            else if (mode == GameControlPaused) {
+                mode = GameControlRunning;
+                pacer.reset();
+            }
+            else
+                stop();
+            break;
+        case 's':
+        case '.':
+            stop();
+            for (int n = count.empty() ? 1 : takeCount(); n; n--)
+                game.step();
+            break;
+        case 'f':
+            runCommand("ff " + to_string(takeCount()));
+            break;
+        case 'm':
+            runCommand("move " + to_string(takeCount()));
+            break;
+        case 'x':
+            runCommand("ext");
+            break;
+        case '+':
+            setRate(pacer.isLimited() ? pacer.getRate() * 2 : 0);
+            break;
+        case '-':
+            setRate(pacer.isLimited() ? pacer.getRate() / 2 : GameControlLimitedRate);
+            break;
+        case '[':
+            view.setZoom(game, view.getZoom() + 1);
+            break;
+        case ']':
+            view.setZoom(game, view.getZoom() - 1);
+            break;
+        case 'h':
+            view.pan(game, -GameControlPanStep, 0);
+            break;
+        case 'j':
+            view.pan(game, 0, GameControlPanStep);
+            break;
+        case 'k':
+            view.pan(game, 0, -GameControlPanStep);
+            break;
+        case 'l':
+            view.pan(game, GameControlPanStep, 0);
+            break;
+        case ':':
+            editing = true;
+            command.clear();
+            break;
+        case KeyEscape:
+            count.clear();
+            if (mode == GameControlSeeking)
+                stop();
+            break;
+        case 'q':
+            quit = true;
+            break;
+    }
+    
+    count.clear();
+}
+
+void GameControl::updateStatus() {
+    string status = "Move " + to_string(game.currentMove()) + "  ";
+    
+    if (editing)
+        status += ":" + command;
+    else {
+        switch (mode) {
+            case GameControlRunning:
+                status += "running";
+                if (pacer.isLimited())
+                    status += " at " + to_string((long)pacer.getRate()) + "/s";
+                break;
+            case GameControlPaused:
+                status += "paused";
+                break;
+            case GameControlSeeking:
+                status += "seeking " + targetName;
+                break;
+        }
+        
+        if (view.canZoom())
+            status += "  " + view.viewport();
+        
+        if (count.length())
+            status += "  " + count;
+        
+        status += "  [space] pause  [s]tep  [f]orward  [x] extinction  [+-] rate";
+        if (view.canZoom())
+            status += "  [hjkl] pan  [[]] zoom";
+        status += "  [:]command  [q]uit";
+    }
+    
+    view.setStatus(status);
+}
+
+volatile std::sig_atomic_t GameControl::interrupted = 0;
+
+bool GameControl::run() {
+    while (!game.isOver() && !quit && !interrupted) {
+        for (int key = UIReadKey(); key != UIKeyNone; key = UIReadKey())
+            handleKey(key);
+        
+        switch (mode) {
+            case GameControlRunning:
+                if (pacer.isLimited()) {
+                    if (pacer.due()) {
+                        auto deadline = std::chrono::steady_clock::now() + InputInterval;
+                        do
+                            pacer.advance(game.step());
+                        while (!game.isOver() && pacer.due() && std::chrono::steady_clock::now() < deadline);
+                    } else
+                        UIWaitKey(pacer.millisecondsUntilDue());
+                } else {
+                    auto deadline = std::chrono::steady_clock::now() + InputInterval;
+                    do
+                        game.step();
+                    while (!game.isOver() && std::chrono::steady_clock::now() < deadline);
+                }
+                break;
+            case GameControlPaused:
+                UIWaitKey(-1);
+                break;
+            case GameControlSeeking: {
+                int budget = GameControlSeekChunk;
+                game.runUntil([this, &budget](Game &game) {
+                    return target(game) || !budget--;
+                });
+                
+                if (game.isOver() || target(game))
+                    stop();
+                break;
+            }
+        }
+        
+        updateStatus();
+    }
+    
+    if (mode == GameControlSeeking)
+        stop();
+    
+    updateStatus();
+    
+    return !quit && !interrupted;
+}
@@ -0,0 +1,60 @@
+#ifndef CONTROL_HPP
+#define CONTROL_HPP
+
+
+#include <string>
+#include <functional>
+#include <csignal>
+#include "game.hpp"
+#include "view.hpp"
+#include "pacer.hpp"
+
+
+static const int GameControlDefaultCount = 1000;
+static const int GameControlSeekChunk    = 4096;
+
+static const int GameControlPanStep = 8;
+
+static const double GameControlLimitedRate = 1024;
+
+typedef enum {
+    GameControlRunning,
+    GameControlPaused,
+    GameControlSeeking
+} GameControlMode;
+
+class GameControl {
+private:
+    Game     &game;
+    GameView &view;
+    
+    GameControlMode mode = GameControlRunning;
+    GamePacer       pacer;
+    
+    std::string                 targetName;
+    std::function<bool(Game &)> target;
+    
+    std::string count;
+    bool        editing = false;
+    std::string command;
+    
+    bool quit = false;
+    
+    int  takeCount();
+    void handleKey(int key);
+    void runCommand(const std::string &command);
+    void seek(const std::string &name, const std::function<bool(Game &)> &target);
+    void stop();
+    void setRate(double rate);
+    void updateStatus();
+public:
+    GameControl(Game &game, GameView &view, double rate = GameMoveRate);
+    
+    // Set from a signal handler to leave run() as if the user quit.
+    static volatile std::sig_atomic_t interrupted;
+    
+    bool run();
+};
+
+
+#endif
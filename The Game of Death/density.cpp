@@ -0,0 +1,71 @@
+#include "density.hpp"
+
+using std::size_t;
+
+
+GameDensity::GameDensity(int width, int height, int levels, int slots) {
+    this->slots = slots > 0 ? slots : 1;
+    
+    for (int k = 1; k <= levels; k++) {
+        Level level;
+        level.columns = (int)(((int64_t)width  + (1 << k) - 1) >> k);
+        level.rows    = (int)(((int64_t)height + (1 << k) - 1) >> k);
+        level.dense   = (uint64_t)level.columns * level.rows * this->slots <= GameDensityDenseCounts;
+        
+        if (level.dense)
+            level.counts.assign((size_t)level.columns * level.rows * this->slots, 0);
+        
+        this->levels.push_back(std::move(level));
+    }
+}
+
+void GameDensity::add(int k, int x, int y, int slot, int delta) {
+    Level &level = levels[k - 1];
+    uint64_t i = key(level, x >> k, y >> k, slot);
+    
+    if (level.dense) {
+        level.counts[i] += delta;
+        return;
+    }
+    
+    uint32_t &count = level.sparse[i];
+    count += delta;
+    if (!count)
+        level.sparse.erase(i);
+}
+
+uint32_t GameDensity::at(int k, int x, int y, int slot) {
+    if (k < 1 || k > (int)levels.size())
+        return 0;
+    
+    Level &level = levels[k - 1];
+    if (x < 0 || x >= level.columns || y < 0 || y >= level.rows)
+        return 0;
+    
+    uint64_t i = key(level, x, y, slot);
+    if (level.dense)
+        return level.counts[i];
+    
+    auto count = level.sparse.find(i);
+    return count != level.sparse.end() ? count->second : 0;
+}
+
+void GameDensity::cellSpawned(Game &game, Race &race, Cell &cell) {
+    for (int k = 1; k <= (int)levels.size(); k++)
+        add(k, cell.x, cell.y, race.id % slots, 1);
+}
+
+void GameDensity::cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) {
+    for (int k = 1; k <= (int)levels.size(); k++) {
+        if (fromX >> k == cell.x >> k && fromY >> k == cell.y >> k)
+            break;
+        
+        add(k, fromX, fromY, race.id % slots, -1);
+        add(k, cell.x, cell.y, race.id % slots, 1);
+    }
+}
+
+void GameDensity::cellDied(Game &game, Race &race, Cell &cell) {
+    for (int k = 1; k <= (int)levels.size(); k++)
+        add(k, cell.x, cell.y, race.id % slots, -1);
+}
@@ -0,0 +1,55 @@
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include "game.hpp"
+
+
+static const uint64_t GameDensityDenseCounts = 1 << 22;
+
+// Per-slot cell counts over an aggregation pyramid: level k counts the cells
+// in each 2^k x 2^k block of the board, for levels 1 to getLevels(). Races
+// share slots by id modulo the slot count. Every spawn, move and death
+// updates one block per level, and a move stops at the first level where
+// both squares fall in the same block, so any block can be read in O(1)
+// without scanning the board. Levels with up to GameDensityDenseCounts
+// counters are flat arrays; finer levels of huge boards are hashes holding
+// only the occupied blocks.
+class GameDensity : public GameObserver {
+private:
+    typedef struct Level {
+        int  columns;
+        int  rows;
+        bool dense;
+        
+        std::vector<uint32_t>                  counts;
+        std::unordered_map<uint64_t, uint32_t> sparse;
+    } Level;
+    
+    int slots;
+    
+    std::vector<Level> levels;
+    
+    uint64_t key(const Level &level, int x, int y, int slot) {
+        return ((uint64_t)y * level.columns + x) * slots + slot;
+    }
+    
+    void add(int level, int x, int y, int slot, int delta);
+public:
+    GameDensity(int width, int height, int levels, int slots);
+    
+    int getLevels() {return (int)levels.size();}
+    int getSlots()  {return slots;}
+    
+    uint32_t at(int level, int x, int y, int slot);
+    
+    void cellSpawned(Game &game, Race &race, Cell &cell) override;
+    void cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) override;
+    void cellDied(Game &game, Race &race, Cell &cell) override;
+};
+
+
+#endif
@@ -1,35 +1,146 @@
 #include "game.hpp"
-#include <chrono>
+#include "program.hpp"
 #include <algorithm>
-#include <set>
+#include <random>
 #include <cstring>
-#include <csignal>
-
-#ifndef _WIN32
-#include <unistd.h>
-#endif
+#include <cmath>
 
 using std::size_t;
-using std::vector;
 using std::string;
-using std::stoi;
-using std::stoul;
 using std::to_string;
 
 
-GameExceptionRef GameExceptionRaceNotFound  = "Race not found!";
-GameExceptionRef GameExceptionBadInsn       = "Bad instruction!";
-GameExceptionRef GameExceptionBadInsnFormat = "Bad instruction format!";
-GameExceptionRef GameExceptionSegFault      = "Cell segmentation fault!";
-GameExceptionRef GameExceptionBadDirection  = "Bad direction!";
+const char *GameErrorString(GameError error) {
+    switch (error) {
+        case GameErrorRaceNotFound:
+            return "Race not found!";
+        case GameErrorBadInsn:
+            return "Bad instruction!";
+        case GameErrorBadInsnFormat:
+            return "Bad instruction format!";
+        case GameErrorSegFault:
+            return "Cell segmentation fault!";
+        case GameErrorBadDirection:
+            return "Bad direction!";
+        case GameErrorInternal:
+            return "Internal error!";
+        case GameErrorTooManyRaces:
+            return "Too many races!";
+        case GameErrorReadFailed:
+            return "Read failed!";
+        case GameErrorSocket:
+            return "Socket error!";
+        case GameErrorBoardFull:
+            return "Board is full!";
+    }
+    
+    return "Unknown error!";
+}
+
+string GameExceptionString(GameExceptionRef exc) {
+    string string(GameErrorString(exc.error));
+    
+    if (exc.detail.length())
+        string = string.substr(0, string.length() - 1) + ": " + exc.detail;
+    
+    if (exc.race != RaceIDNone)
+        string += " (race " + to_string(exc.race) +
+                  ", pc " + to_string(exc.pc) +
+                  ", move " + to_string(exc.move) + ")";
+    
+    return string;
+}
+
+bool GameExceptionIsFault(GameExceptionRef exc) {
+    switch (exc.error) {
+        case GameErrorBadInsn:
+        case GameErrorBadInsnFormat:
+        case GameErrorSegFault:
+        case GameErrorBadDirection:
+            return exc.race != RaceIDNone;
+        default:
+            return false;
+    }
+}
+
+const char *GameLayoutString(GameLayout layout) {
+    switch (layout) {
+        case GameLayoutUniform:
+            return "uniform";
+        case GameLayoutQuadrant:
+            return "quadrant";
+        case GameLayoutClustered:
+            return "clustered";
+        case GameLayoutSymmetric:
+            return "symmetric";
+    }
+    
+    return "unknown";
+}
+
+bool GameLayoutFromString(const string &string, GameLayout &layout) {
+    for (int i = 0; i < GameLayoutCount; i++) {
+        if (string == GameLayoutString((GameLayout)i)) {
+            layout = (GameLayout)i;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+string GameFaultString(Game &game, const GameFault &fault) {
+    Race &race = game.raceWithID(fault.exception.race);
+    Cell  cell = fault.cell;
+    
+    string string = race.name + " disqualified: " + GameExceptionString(fault.exception) + "\n" +
+                    "  cell " + to_string(fault.cellIndex) + " at " + to_string(cell.x) + "," + to_string(cell.y) +
+                    ", weight " + to_string(cell.weight) +
+                    ", facing " + (cell.direction <= DirectionMax ? cell.directionString() : "nowhere") +
+                    ", pc " + to_string(cell.pc) + ", repeat " + to_string(cell.repCnt) + "\n";
+    
+    for (size_t i = 0; i < fault.races.size() && i < game.raceCount(); i++)
+        string += "  " + game.raceWithIndex(i).name + ": " + to_string(fault.races[i].cells) + " cells, biomass " +
+                  to_string(fault.races[i].biomass) + "\n";
+    
+    string += "  last " + to_string(fault.trace.size()) + " instructions:";
+    for (const GameTraceEntry &entry : fault.trace)
+        string += "\n    move " + to_string(entry.move) + " race " + to_string(entry.race) +
+                  " cell " + to_string(entry.cell) + " pc " + to_string(entry.pc) + " " +
+                  GameOpString((GameOp)entry.op) + " weight " + to_string(entry.weight);
+    
+    return string;
+}
 
 
-uint32_t GameRandom() {
-    return arc4random();
+void GameRandom::seed(uint64_t seed) {
+    state = seed;
+}
+
+uint32_t GameRandom::next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+uint32_t GameRandom::below(uint32_t bound) {
+    if (bound < 2)
+        return 0;
+    
+    uint64_t m = (uint64_t)next() * bound;
+    if ((uint32_t)m < bound) {
+        uint32_t threshold = -bound % bound;
+        while ((uint32_t)m < threshold)
+            m = (uint64_t)next() * bound;
+    }
+    
+    return (uint32_t)(m >> 32);
 }
 
-uint32_t GameRandomBelow(uint32_t i) {
-    return arc4random_uniform(i);
+uint64_t GameRandomSeed() {
+    std::random_device device;
+    return ((uint64_t)device() << 32) | device();
 }
 
 
@@ -50,7 +161,7 @@ const char *Cell::directionString() {
             return "west";
     }
     
-    throw GameExceptionBadDirection;
+    throw GameException(GameErrorBadDirection);
 }
 
 static void movePosInDirection(int &x, int &y, Direction dir) {
@@ -70,7 +181,7 @@ static void movePosInDirection(int &x, int &y, Direction dir) {
     }
 }
 
-Cell *Cell::nearEnemy(Game &game, Race &race) {
+Cell *Cell::nearEnemy(Game &game, Race &race, RaceID *enemyRace) {
     Direction scanDir = direction;
     for (int i = 0; i < 4; i++) {
         int scanX = x;
@@ -80,10 +191,13 @@ Cell *Cell::nearEnemy(Game &game, Race &race) {
         
         Direction nDir = (Direction)(((int)scanDir + 1) % 4);
         for (int j = 0; j < 3; j++) {
-            UIColor color;
-            Cell *enemy = game.cellAt(scanX, scanY, &color);
-            if (enemy && color != race.color)
+            RaceID id;
+            Cell *enemy = game.cellAt(scanX, scanY, &id);
+            if (enemy && id != race.id) {
+                if (enemyRace)
+                    *enemyRace = id;
                 return enemy;
+            }
             
             movePosInDirection(scanX, scanY, nDir);
         }
@@ -94,6 +208,11 @@ Cell *Cell::nearEnemy(Game &game, Race &race) {
     return nullptr;
 }
 
+// Weight after turns more steps of a repeated eat with repCnt left.
+static long eatRun(long weight, int repCnt, uint64_t turns) {
+    return weight + (long)(turns * repCnt - turns * (turns - 1) / 2);
+}
+
 void Cell::eat() {
     weight++;
 }
@@ -122,17 +241,20 @@ void Cell::clon(Game &game, Race &race) {
     Cell *healCell = game.cellAt(dstX, dstY);
     if (healCell) {
         if (healCell->weight <= 0)
-            game.fatal("bad heal");
+            throw GameException(GameErrorInternal, "bad heal");
         
         healCell->weight += 2;
     } else {
         Cell newCell;
         newCell.x = dstX;
         newCell.y = dstY;
+        newCell.direction = (Direction)game.randomBelow(DirectionMax + 1);
         
         race.cells.push_back(newCell);
+        race.clones++;
         
-        game.drawNewCell();
+        game.cellSpawned(race, race.cells.back());
+        game.cellCloned(race, race.cells.back());
     }
 }
 
@@ -140,9 +262,22 @@ void Cell::str(Game &game, Race &race) {
     if (--weight <= 0)
         return;
     
-    Cell *enemy = nearEnemy(game, race);
-    if (enemy)
-        enemy->weight -= GameRandomBelow(3 + (uint32_t)weight / 2);
+    RaceID enemyID;
+    Cell *enemy = nearEnemy(game, race, &enemyID);
+    if (enemy) {
+        long damage = game.randomBelow(3 + (uint32_t)weight / 2);
+        
+        Race &enemyRace = game.raceWithID(enemyID);
+        enemyRace.settle(*enemy);
+        enemy->weight -= damage;
+        
+        game.cellHit(race, *this, enemyRace, *enemy, damage);
+        
+        if (enemy->weight <= 0) {
+            race.kills++;
+            game.cellDied(enemyRace, *enemy);
+        }
+    }
 }
 
 void Cell::left() {
@@ -157,8 +292,8 @@ void Cell::back() {
     direction = (Direction)((int)direction + (direction > DirectionEast? -2 : 2));
 }
 
-void Cell::turn() {
-    direction = (Direction)(GameRandomBelow(DirectionMax + 1));
+void Cell::turn(Game &game) {
+    direction = (Direction)(game.randomBelow(DirectionMax + 1));
 }
 
 void Cell::jg(int m, size_t addr) {
@@ -180,48 +315,110 @@ void Cell::je(Game &game, Race &race, size_t addr) {
         pc = addr;
 }
 
-const char *Race::colorString() {
-    switch (color) {
-        case UIColorGreen:
-            return "Green";
-        case UIColorRed:
-            return "Red";
-        case UIColorYellow:
-            return "Yellow";
-        case UIColorBlue:
-            return "Blue";
-    }
+const GameInsn &Race::fetchInsn(size_t &pc) {
+    if (!program || pc >= program->insn.size())
+        throw GameException(GameErrorSegFault);
+    
+    return program->insn[pc++];
 }
 
-vector<string> Race::fetchInsn(size_t &pc) {
-    if (pc >= insn.size())
-        throw GameExceptionSegFault;
+void Race::load(const string &path, GameProgramCache *cache) {
+    if (cache)
+        program = cache->load(path);
+    else {
+        GameProgram *program = new GameProgram;
+        try {
+            program->load(path);
+        } catch (...) {
+            delete program;
+            throw;
+        }
+        
+        this->program.reset(program);
+    }
+    
+    this->path = path;
+    
+    if (name.empty()) {
+        size_t slash = path.rfind('/');
+        size_t base  = slash == path.npos ? 0 : slash + 1;
+        size_t dot   = path.rfind('.');
+        if (dot == path.npos || dot < base)
+            dot = path.length();
+        
+        name = path.substr(base, dot - base);
+    }
     
-    return insn[pc++];
 }
 
-Cell &Race::nextCell() {
-    if (nextCellIndex >= cells.size())
+size_t Race::nextCell() {
+    if (nextCellIndex >= cells.size()) {
         nextCellIndex = 0;
+        passes++;
+    }
     
-    return cells[nextCellIndex++];
+    return nextCellIndex++;
 }
 
-Cell &Race::prevCell() {
-    if (nextCellIndex)
-        return cells[nextCellIndex - 1];
+void Race::settle(Cell &cell) {
+    if (cell.rep != CellInsnRepEat || !cell.repCnt || cell.weight <= 0)
+        return;
+    
+    uint64_t now   = turnsPast(&cell - cells.data());
+    uint64_t turns = std::min<uint64_t>(now - cell.repSince, cell.repCnt);
     
-    return cells.back();
+    cell.weight    = eatRun(cell.weight, cell.repCnt, turns);
+    cell.repCnt   -= (int)turns;
+    cell.repSince  = now;
 }
 
+void Race::reset() {
+    nextCellIndex  = 0;
+    passes         = 0;
+    extinct        = false;
+    extinctionDate = RaceExtinctionDateNone;
+    disqualified   = false;
+    
+    clones = 0;
+    kills  = 0;
+    wasted = 0;
+    living = 0;
+    
+    cells.clear();
+}
 
-Game::Game(UIDisplay *display) {
-    this->display = display;
+RaceStats Race::stats() {
+    RaceStats stats;
+    stats.clones = clones;
+    stats.kills  = kills;
+    stats.wasted = wasted;
     
-    for (int x = 0; x < GameBoxWidth; x++)
-        display->putChar(x, GameBoxHeight, '=');
-    for (int y = 0; y < GameBoxHeight + 1; y++)
-        display->putChar(GameBoxWidth, y, '|');
+    for (Cell &cell : cells)
+        if (cell.weight > 0) {
+            settle(cell);
+            stats.cells++;
+            stats.biomass += cell.weight;
+        }
+    
+    return stats;
+}
+
+
+Game::Game(const GameConfig &config) : world(config.width, config.height) {
+    this->config = config;
+    
+    if (!this->config.seed)
+        this->config.seed = GameRandomSeed();
+    
+    rng.seed(this->config.seed);
+}
+
+void Game::addObserver(GameObserver *observer) {
+    observers.push_back(observer);
+}
+
+void Game::removeObserver(GameObserver *observer) {
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
 }
 
 Race &Game::nextRace() {
@@ -231,77 +428,228 @@ Race &Game::nextRace() {
     return races[nextRaceIndex++];
 }
 
-void Game::removeRaceWithColor(UIColor color) {
-    for (auto i = races.begin(); i < races.end(); i++)
-        if (i->color == color) {
-            races.erase(i);
-            break;
-        }
+Race &Game::addRace(const Race &race) {
+    if (races.size() >= RaceCountMax)
+        throw GameException(GameErrorTooManyRaces);
+    
+    races.push_back(race);
+    
+    Race &added = races.back();
+    added.id = (RaceID)(races.size() - 1);
     
-    throw GameExceptionRaceNotFound;
+    if (populated)
+        populate(added);
+    
+    return added;
 }
 
-void Game::addRace(Race &race) {
-    races.push_back(race);
+// Seeds every race in one pass once they have all been added. The first
+// step does this by itself; callers that show or inspect the starting
+// board call it first.
+void Game::populate() {
+    if (populated)
+        return;
     
-    for (int i = 0; i < GameInitialPopulation; i++) {
+    populated = true;
+    
+    size_t mirrored = 0;
+    if (config.layout == GameLayoutSymmetric) {
+        mirrored = std::min(races.size(), (size_t)GameLayoutSymmetries);
+        populateMirrored(mirrored);
+    }
+    
+    for (size_t i = mirrored; i < races.size(); i++)
+        populate(races[i]);
+}
+
+void Game::populate(Race &race) {
+    static const int quadrants[] = {0, 3, 1, 2};
+    
+    int width  = config.width;
+    int height = config.height;
+    
+    int left = 0, top = 0;
+    int right = width, bottom = height;
+    
+    if (config.layout == GameLayoutQuadrant) {
+        int quadrant = quadrants[race.id % 4];
+        left   = quadrant & 1 ? width / 2 : 0;
+        right  = quadrant & 1 ? width : width / 2;
+        top    = quadrant & 2 ? height / 2 : 0;
+        bottom = quadrant & 2 ? height : height / 2;
+    } else if (config.layout == GameLayoutClustered) {
+        int side = (int)std::ceil(std::sqrt(2.0 * config.initialPopulation));
+        int centerX, centerY;
+        randomEmpty(centerX, centerY);
+        
+        left   = std::max(0, std::min(centerX - side / 2, width - side));
+        top    = std::max(0, std::min(centerY - side / 2, height - side));
+        right  = std::min(width, left + side);
+        bottom = std::min(height, top + side);
+    }
+    
+    bool anywhere = config.layout == GameLayoutUniform || config.layout == GameLayoutSymmetric ||
+                    right <= left || bottom <= top;
+    
+    for (int i = 0; i < config.initialPopulation; i++) {
         Cell cell;
-        randomEmpty(cell.x, cell.y);
+        cell.direction = (Direction)randomBelow(DirectionMax + 1);
         
-        display->putChar(cell.x, cell.y, CellCharacter | UIAttrForColor(race.color));
+        if (anywhere)
+            randomEmpty(cell.x, cell.y);
+        else
+            randomEmptyIn(left, top, right - left, bottom - top, cell.x, cell.y);
         
-        races[races.size() - 1].cells.push_back(cell);
+        race.cells.push_back(cell);
+        cellSpawned(race, race.cells.back());
     }
+}
+
+// Race 1 is mirrored across both axes, race 2 left to right and race 3 top
+// to bottom.
+static Cell mirrorCell(const Cell &image, RaceID race, int width, int height) {
+    bool flipX = race != 3;
+    bool flipY = race != 2;
     
-    bool *test = new bool[GameBoxWidth * GameBoxHeight];
-    memset(test, false, GameBoxWidth * GameBoxHeight * sizeof(bool));
+    Cell cell;
+    cell.x = flipX ? width - 1 - image.x : image.x;
+    cell.y = flipY ? height - 1 - image.y : image.y;
     
-    for (auto &race : races) {
-        for (auto &cell : race.cells) {
-            if (test[cell.y * GameBoxWidth + cell.x])
-                fatal("bug!");
-            
-            test[cell.y * GameBoxWidth + cell.x] = true;
+    int turn = image.direction == DirectionEast || image.direction == DirectionWest ? flipX : flipY;
+    cell.direction = (Direction)((image.direction + 2 * turn) % (DirectionMax + 1));
+    
+    return cell;
+}
+
+void Game::populateMirrored(size_t count) {
+    int width  = config.width;
+    int height = config.height;
+    
+    auto fits = [this, count, width, height](int x, int y) {
+        Cell cell;
+        cell.x = x;
+        cell.y = y;
+        
+        if (!isVisitable(x, y))
+            return false;
+        
+        for (size_t id = 1; id < count; id++) {
+            Cell image = mirrorCell(cell, (RaceID)id, width, height);
+            if (!isVisitable(image.x, image.y))
+                return false;
+        }
+        
+        return true;
+    };
+    
+    for (int i = 0; i < config.initialPopulation; i++) {
+        Cell cell;
+        cell.direction = (Direction)randomBelow(DirectionMax + 1);
+        
+        bool found = false;
+        for (int attempt = 0; attempt < GameLayoutAttempts && !found && width > 1 && height > 1; attempt++) {
+            cell.x = randomBelow(width / 2);
+            cell.y = randomBelow(height / 2);
+            found  = fits(cell.x, cell.y);
+        }
+        
+        for (int y = 0; y < height / 2 && !found; y++)
+            for (int x = 0; x < width / 2 && !found; x++)
+                if (fits(x, y)) {
+                    cell.x = x;
+                    cell.y = y;
+                    found  = true;
+                }
+        
+        if (!found)
+            throw GameException(GameErrorBoardFull, "no room left for a symmetric start");
+        
+        for (size_t id = 0; id < count; id++) {
+            Race &race = races[id];
+            race.cells.push_back(id ? mirrorCell(cell, race.id, width, height) : cell);
+            cellSpawned(race, race.cells.back());
         }
     }
 }
 
+Race &Game::addRace(const string &name, GameProgramRef program) {
+    Race race;
+    race.name    = name;
+    race.program = program;
+    
+    return addRace(race);
+}
+
 Race &Game::raceWithIndex(size_t index) {
     if (index >= races.size())
-        throw GameExceptionRaceNotFound;
+        throw GameException(GameErrorRaceNotFound);
     
     return races[index];
 }
 
-Race &Game::raceWithColor(UIColor color) {
-    for (size_t i = 0; i < races.size(); i++)
-        if (races[i].color == color)
-            return races[i];
+Race &Game::raceWithID(RaceID id) {
+    return raceWithIndex(id);
+}
+
+Cell *Game::cellAt(int x, int y, RaceID *id) {
+    GameSquare *square = world.find(x, y);
+    if (!square)
+        return nullptr;
     
-    throw GameExceptionRaceNotFound;
+    Cell &cell = races[square->race].cells[square->cell];
+    if (cell.weight <= 0)
+        return nullptr;
+    
+    if (id)
+        *id = square->race;
+    return &cell;
 }
 
-Cell *Game::cellAt(int x, int y, UIColor *color) {
-    for (auto &race : races)
-        for (auto &cell : race.cells)
-            if (cell.x == x && cell.y == y &&
-                cell.weight > 0) {
-                if (color)
-                    *color = race.color;
-                return &cell;
-            }
+void Game::cellSpawned(Race &race, Cell &cell) {
+    if (world.find(cell.x, cell.y))
+        throw GameException(GameErrorInternal, "overlapping cells");
     
-    return nullptr;
+    GameSquare square;
+    square.race = race.id;
+    square.cell = (uint32_t)(&cell - race.cells.data());
+    world.put(cell.x, cell.y, square);
+    race.living++;
+    
+    for (GameObserver *observer : observers)
+        observer->cellSpawned(*this, race, cell);
 }
 
-void Game::drawNewCell() {
-    Race &race = races[nextRaceIndex - 1];
-    Cell &cell = race.prevCell();
-    display->putChar(cell.x, cell.y, CellCharacter | UIAttrForColor(race.color));
+void Game::cellMoved(Race &race, Cell &cell, int fromX, int fromY) {
+    for (GameObserver *observer : observers)
+        observer->cellMoved(*this, race, cell, fromX, fromY);
+}
+
+void Game::cellDied(Race &race, Cell &cell) {
+    world.erase(cell.x, cell.y);
+    race.living--;
+    
+    for (GameObserver *observer : observers)
+        observer->cellDied(*this, race, cell);
+}
+
+void Game::cellCloned(Race &race, Cell &cell) {
+    for (GameObserver *observer : observers)
+        observer->cellCloned(*this, race, cell);
+}
+
+void Game::cellHit(Race &race, Cell &cell, Race &enemyRace, Cell &enemy, long damage) {
+    for (GameObserver *observer : observers)
+        observer->cellHit(*this, race, cell, enemyRace, enemy, damage);
 }
 
 void Game::moveIfPossible(int &x, int &y, int dstX, int dstY) {
     if (isVisitable(dstX, dstY)) {
+        GameSquare *square = world.find(x, y);
+        if (square) {
+            world.put(dstX, dstY, *square);
+            world.erase(x, y);
+        }
+        
         x = dstX;
         y = dstY;
     }
@@ -312,86 +660,38 @@ bool Game::isVisitable(int x, int y) {
 }
 
 bool Game::isLegal(int x, int y) {
-    if (x < 0 || x >= GameBoxWidth ||
-        y < 0 || y >= GameBoxHeight)
-        return false;
-    
-    return true;
+    return world.contains(x, y);
 }
 
 bool Game::isEmpty(int x, int y) {
-    for (Race &race : races)
-        for (Cell &cell : race.cells)
-            if (cell.weight > 0 &&
-                cell.x == x && cell.y == y)
-                return false;
-    
-    return true;
+    return !cellAt(x, y);
 }
 
 void Game::randomEmpty(int &x, int &y) {
-    do {
-        x = GameRandomBelow(GameBoxWidth);
-        y = GameRandomBelow(GameBoxHeight);
-    } while (!isVisitable(x, y));
-}
-
-void Game::logLine(string &string) {
-    int y = logY;
-    int h = display->getHeight();
+    if (world.occupiedCount() >= (uint64_t)config.width * config.height)
+        throw GameException(GameErrorBoardFull);
     
-    if (y < h)
-        logY++;
-    else {
-        y--;
-        
-        display->eraseLine(GameBoxHeight + 1);
-        for (int y = GameBoxHeight + 2; y < h; y++)
-            display->copyLine(y - 1, y);
-        display->eraseLine(h - 1);
+    if (world.isDense()) {
+        world.emptySquare(randomBelow((uint32_t)world.emptyCount()), x, y);
+        return;
     }
     
-    display->putString(0, y, string);
+    do {
+        x = randomBelow(config.width);
+        y = randomBelow(config.height);
+    } while (!isVisitable(x, y));
 }
 
-void Game::log(const char *msg) {
-    while (true) {
-        string line;
+void Game::randomEmptyIn(int left, int top, int width, int height, int &x, int &y) {
+    for (int i = 0; i < GameLayoutAttempts; i++) {
+        x = left + randomBelow(width);
+        y = top  + randomBelow(height);
         
-        const char *lf = std::strchr(msg, '\n');
-        if (lf)
-            line = string(msg, lf - msg);
-        else
-            line = string(msg);
-        
-        logLine(line);
-        
-        if (!lf)
-            break;
-        
-        msg = lf + 1;
+        if (isVisitable(x, y))
+            return;
     }
-}
-
-void Game::log(const string &string) {
-    log(string.c_str());
-}
-
-void Game::fatal(const char *msg) {
-    log(msg);
-    
-    //display->setAutoFlush(false);
     
-    while (true)
-#ifndef _WIN32
-        pause();
-#else
-        std::this_thread::yield();
-#endif
-}
-
-void Game::fatal(const string &string) {
-    fatal(string.c_str());
+    randomEmpty(x, y);
 }
 
 Race &Game::raceStep() {
@@ -399,204 +699,293 @@ Race &Game::raceStep() {
     if (race.extinct)
         return race;
     
-    Cell &cell = race.nextCell();
-    for (size_t i = 1; cell.weight <= 0; i++) {
+    size_t index = race.nextCell();
+    for (size_t i = 1; race.cells[index].weight <= 0; i++) {
         if (i >= race.cells.size()) {
             race.extinct = true;
             return race;
         }
         
-        cell = race.nextCell();
+        index = race.nextCell();
     }
-
-    int prevX = cell.x;
-    int prevY = cell.y;
     
-    if (cell.repCnt) {
-        for (int i = 0; i < cell.repCnt; i++)
-            switch (cell.rep) {
-                case CellInsnRepEat:
-                    cell.eat();
-                    break;
-                case CellInsnRepGo:
-                    cell.go(*this);
-                    break;
-                case CellInsnRepStr:
-                    cell.str(*this, race);
-                    break;
-            }
+    Cell *cell = &race.cells[index];
+    
+    if (cell->rep == CellInsnRepEat && cell->repCnt) {
+        uint64_t turns = race.turnsPast(index) - cell->repSince;
+        record(race, index, cell->pc, GameOpEat, eatRun(cell->weight, cell->repCnt, turns - 1));
         
-        cell.repCnt--;
-    } else {
-        for (int i = 0;; i++) {
-            
-            
-            if (i >= 30) {
-                cell.weight -= 5;
-                break;
-            }
-            
-            const vector<string> insn = race.fetchInsn(cell.pc);
-            
-            bool
-            isEat   = false,
-            isGo    = false,
-            isClon  = false,
-            isStr   = false,
-            isLeft  = false,
-            isRight = false,
-            isBack  = false,
-            isTurn  = false,
-            isJg    = false,
-            isJl    = false,
-            isJ     = false,
-            isJe    = false;
+        if (turns >= (uint64_t)cell->repCnt)
+            race.settle(*cell);
+        
+        return race;
+    }
+    
+    int prevX = cell->x;
+    int prevY = cell->y;
+    
+    size_t insnPC = cell->pc;
+    cell->repSince = race.turnsPast(index);
+    
+    try {
+        if (cell->repCnt) {
+            record(race, index, cell->pc, cell->rep == CellInsnRepGo ? GameOpGo : GameOpStr, cell->weight);
             
-            if (!(isEat   = insn[0] == "eat")   &&
-                !(isGo    = insn[0] == "go")    &&
-                !(isClon  = insn[0] == "clon")  &&
-                !(isStr   = insn[0] == "str")   &&
-                !(isLeft  = insn[0] == "left")  &&
-                !(isRight = insn[0] == "right") &&
-                !(isBack  = insn[0] == "back")  &&
-                !(isTurn  = insn[0] == "turn")  &&
-                !(isJg    = insn[0] == "jg")    &&
-                !(isJl    = insn[0] == "jl")    &&
-                !(isJ     = insn[0] == "j")     &&
-                !(isJe    = insn[0] == "je"))
-                throw GameExceptionBadInsn;
+            for (int i = 0; i < cell->repCnt; i++)
+                switch (cell->rep) {
+                    case CellInsnRepEat:
+                        cell->eat();
+                        break;
+                    case CellInsnRepGo:
+                        cell->go(*this);
+                        break;
+                    case CellInsnRepStr:
+                        cell->str(*this, race);
+                        break;
+                }
+
+            cell->repCnt--;
+        } else {
+            const GameProgram *program = race.program.get();
+            bool fused = program && program->fused.size() == program->insn.size();
             
-            if (isEat   ||
-                isGo    ||
-                isStr   ||
-                isLeft  ||
-                isRight) {
-                cell.repCnt = 1;
-                
-                if (insn.size() == 2) {
-                    if (insn[1] == "r") {
-                        if (!isEat &&
-                            !isGo)
-                            throw GameExceptionBadInsnFormat;
+            for (int i = 0;; i++) {
+                if (fused && cell->pc < program->fused.size()) {
+                    const GameFusion &run = program->fused[cell->pc];
+                    
+                    if (run.ends != GameOpBad && i + run.length < GameInsnBudget) {
+                        for (int t = 0; t < run.turns; t++)
+                            cell->turn(*this);
                         
-                        cell.repCnt = GameRandomBelow(6);
-                    } else {
-                        try {
-                            cell.repCnt = stoi(insn[1], nullptr, 0);
-                        } catch (...) {
-                            cell.repCnt = -1;
+                        cell->direction = (Direction)(((int)cell->direction + run.rotate) % (DirectionMax + 1));
+                        if (run.repCnt >= 0)
+                            cell->repCnt = run.repCnt;
+                        
+                        const GameInsn &insn = program->insn[run.next];
+                        insnPC   = run.next;
+                        cell->pc = run.next + 1;
+                        i += run.length;
+                        record(race, index, insnPC, insn.op, cell->weight);
+                        
+                        if (run.ends == GameOpJg)
+                            cell->jg(insn.count, insn.addr);
+                        else if (run.ends == GameOpJl)
+                            cell->jl(insn.count, insn.addr);
+                        else if (run.ends == GameOpJe)
+                            cell->je(*this, race, insn.addr);
+                        else {
+                            perform(race, *cell, insn);
+                            break;
                         }
                         
-                        if (cell.repCnt < 2 || cell.repCnt > 99)
-                            throw GameExceptionBadInsnFormat;
+                        continue;
                     }
-                } else if (insn.size() > 2)
-                    throw GameExceptionBadInsnFormat;
-                
-                if (cell.repCnt) {
-                    if (isEat) {
-                        cell.rep = CellInsnRepEat;
-                        cell.eat();
-                    } else if (isGo) {
-                        cell.rep = CellInsnRepGo;
-                        cell.go(*this);
-                    } else if (isStr) {
-                        cell.rep = CellInsnRepStr;
-                        cell.str(*this, race);
-                    } else if (isLeft) {
-                        for (int j = 0; j < cell.repCnt && i < 30; j++)
-                            cell.left();
-                    } else
-                        cell.right();
-                    
-                    cell.repCnt--;
                 }
-            } else if (isClon)
-                cell.clon(*this, race);
-            else if (isBack)
-                cell.back();
-            else if (isTurn) {
-                if (insn.size() != 2 ||
-                    insn[1] != "r")
-                    throw GameExceptionBadInsnFormat;
-                
-                cell.turn();
-            } else if (isJg ||
-                       isJl) {
-                if (insn.size() != 3)
-                    throw GameExceptionBadInsnFormat;
                 
-                int m;
-                size_t addr;
-                try {
-                    m    = stoi(insn[1], nullptr, 0);
-                    addr = stoul(insn[2], nullptr, 0);
-                } catch (...) {
-                    throw GameExceptionBadInsnFormat;
+                if (i >= GameInsnBudget) {
+                    cell->weight -= 5;
+                    race.wasted++;
+                    break;
                 }
                 
-                if (isJg)
-                    cell.jg(m, addr);
-                else
-                    cell.jl(m, addr);
-            } else if (isJ ||
-                       isJe) {
-                if (insn.size() != 2)
-                    throw GameExceptionBadInsnFormat;
+                insnPC = cell->pc;
+                const GameInsn &insn = race.fetchInsn(cell->pc);
+                record(race, index, insnPC, insn.op, cell->weight);
                 
-                size_t addr;
-                try {
-                    addr = stol(insn[1], nullptr, 0);
-                } catch (...) {
-                    throw GameExceptionBadInsnFormat;
+                switch (insn.op) {
+                    case GameOpEat:
+                    case GameOpGo:
+                    case GameOpStr:
+                    case GameOpLeft:
+                    case GameOpRight:
+                    case GameOpClon:
+                        perform(race, *cell, insn);
+                        break;
+                    case GameOpBack:
+                        cell->back();
+                        break;
+                    case GameOpTurn:
+                        cell->turn(*this);
+                        break;
+                    case GameOpJg:
+                        cell->jg(insn.count, insn.addr);
+                        break;
+                    case GameOpJl:
+                        cell->jl(insn.count, insn.addr);
+                        break;
+                    case GameOpJ:
+                        cell->j(insn.addr);
+                        break;
+                    case GameOpJe:
+                        cell->je(*this, race, insn.addr);
+                        break;
+                    case GameOpBad:
+                        throw GameException(insn.error);
                 }
                 
-                if (isJ)
-                    cell.j(addr);
-                else
-                    cell.je(*this, race, addr);
+                if (GameOpIsAction(insn.op))
+                    break;
             }
-            
-            if (isEat  ||
-                isGo   ||
-                isClon ||
-                isStr)
-                break;
         }
+    } catch (GameException &exc) {
+        exc.race = race.id;
+        exc.pc   = insnPC;
+        exc.move = move + 1;
+        
+        if (!GameExceptionIsFault(exc))
+            throw;
+        
+        disqualify(race, index, exc);
+        return race;
     }
     
-    if (cell.x != prevX ||
-        cell.y != prevY) {
-        display->putChar(prevX, prevY, ' ');
-        display->putChar(cell.x, cell.y, CellCharacter | UIAttrForColor(race.color));
-    }
+    cell = &race.cells[index];
+    
+    if (cell->x != prevX ||
+        cell->y != prevY)
+        cellMoved(race, *cell, prevX, prevY);
+    
+    if (cell->weight <= 0)
+        cellDied(race, *cell);
     
     return race;
 }
 
-void Game::extinctionAlert(const char *colorString) {
-    log(string("[ATTENTION] ") + colorString + string(" race extinct!"));
-    UIAttention();
+void Game::perform(Race &race, Cell &cell, const GameInsn &insn) {
+    if (insn.op == GameOpClon) {
+        cell.clon(*this, race);
+        return;
+    }
+    
+    cell.repCnt = insn.random ? randomBelow(6) : insn.count;
+    if (!cell.repCnt)
+        return;
+    
+    if (insn.op == GameOpEat) {
+        cell.rep = CellInsnRepEat;
+        cell.eat();
+    } else if (insn.op == GameOpGo) {
+        cell.rep = CellInsnRepGo;
+        cell.go(*this);
+    } else if (insn.op == GameOpStr) {
+        cell.rep = CellInsnRepStr;
+        cell.str(*this, race);
+    } else if (insn.op == GameOpLeft) {
+        for (int j = 0; j < cell.repCnt; j++)
+            cell.left();
+    } else
+        cell.right();
+    
+    cell.repCnt--;
+}
+
+void Game::record(Race &race, size_t index, size_t pc, uint8_t op, long weight) {
+    GameTraceEntry &entry = trace[traceCount++ % GameTraceLength];
+    entry.move   = move + 1;
+    entry.race   = race.id;
+    entry.cell   = (uint32_t)index;
+    entry.pc     = pc;
+    entry.op     = op;
+    entry.weight = weight;
 }
 
-void Game::start() {
-    bool cont = true;
-    for (int i = 0; i < GameMoveNumber && cont; i++) {
-        cont = false;
-        
+void Game::disqualify(Race &race, size_t index, GameExceptionRef exc) {
+    GameFault fault(exc);
+    fault.cellIndex = index;
+    fault.cell      = race.cells[index];
+    
+    for (Race &each : races)
+        fault.races.push_back(each.stats());
+    
+    size_t count = std::min(traceCount, GameTraceLength);
+    for (size_t i = traceCount - count; i < traceCount; i++)
+        fault.trace.push_back(trace[i % GameTraceLength]);
+    
+    race.disqualified = true;
+    race.extinct      = true;
+    
+    for (Cell &cell : race.cells) {
+        if (cell.weight > 0) {
+            race.settle(cell);
+            cell.weight = 0;
+            cellDied(race, cell);
+        }
+    }
+    
+    faults.push_back(fault);
+    
+    for (GameObserver *observer : observers)
+        observer->raceDisqualified(*this, race, faults.back());
+}
+
+void Game::endMove() {
+    move++;
+    
+    size_t alive = 0;
+    for (Race &race : races) {
+        if (!race.extinct) {
+            alive++;
+        } else if (race.extinctionDate == RaceExtinctionDateNone) {
+            race.extinctionDate = move;
+            
+            for (GameObserver *observer : observers)
+                observer->raceExtinct(*this, race);
+        }
+    }
+    
+    if (!alive || move >= config.moveNumber ||
+        (config.stopAtLastSurvivor && alive == 1 && races.size() > 1))
+        over = true;
+    
+    for (GameObserver *observer : observers)
+        observer->moveEnded(*this);
+}
+
+size_t Game::step(size_t n) {
+    populate();
+    
+    size_t i = 0;
+    for (; i < n && !over; i++) {
         for (size_t j = 0; j < races.size(); j++)
             raceStep();
         
-        for (Race &race : races) {
-            if (!race.extinct) {
-                cont = true;
-            } else if (race.extinctionDate == RaceExtinctionDateNone) {
-                extinctionAlert(race.colorString());
-                race.extinctionDate = i + 1;
-            }
-        }
-        
-        if (GameStepDelay)
-            std::this_thread::sleep_for(std::chrono::milliseconds(GameStepDelay));
+        endMove();
     }
+    
+    return i;
+}
+
+void Game::reset(uint64_t seed) {
+    config.seed = seed ? seed : GameRandomSeed();
+    rng.seed(config.seed);
+    
+    nextRaceIndex = 0;
+    
+    move = 0;
+    over = false;
+    
+    traceCount = 0;
+    faults.clear();
+    
+    for (Race &race : races)
+        race.reset();
+    
+    world.clear();
+    
+    populated = false;
+    populate();
+}
+
+void Game::settle() {
+    for (Race &race : races)
+        for (Cell &cell : race.cells)
+            race.settle(cell);
+}
+
+size_t Game::runUntil(const std::function<bool(Game &)> &predicate) {
+    size_t n = 0;
+    while (!over && !predicate(*this))
+        n += step();
+    
+    return n;
 }
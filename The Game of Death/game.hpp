@@ -6,34 +6,131 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
 #include "config.hpp"
-#include "ncui.hpp"
-
-
-#if defined(__clang__) || defined(__GNUC__)
-#define NORETURN __attribute__((__noreturn__))
-#else
-#define NORETURN
-#endif
+#include "world.hpp"
 
 
 class Game;
 typedef struct Race Race;
+typedef struct Cell Cell;
+typedef struct GameInsn GameInsn;
+typedef struct GameProgram GameProgram;
+class GameProgramCache;
+
+typedef std::shared_ptr<const GameProgram> GameProgramRef;
+
+
+static const std::size_t RaceCountMax = RaceIDNone;
+
+
+typedef enum {
+    GameErrorRaceNotFound,
+    GameErrorBadInsn,
+    GameErrorBadInsnFormat,
+    GameErrorSegFault,
+    GameErrorBadDirection,
+    GameErrorInternal,
+    GameErrorTooManyRaces,
+    GameErrorReadFailed,
+    GameErrorSocket,
+    GameErrorBoardFull
+} GameError;
+
+const char *GameErrorString(GameError error);
+
+typedef struct GameException {
+    GameError   error;
+    std::string detail;
+    
+    RaceID      race = RaceIDNone;
+    std::size_t pc   = 0;
+    int         move = 0;
+    
+    GameException(GameError error, const std::string &detail = std::string())
+    : error(error), detail(detail) {}
+} GameException;
+
+typedef const GameException &GameExceptionRef;
 
-typedef const char *const GameExceptionRef;
-extern GameExceptionRef GameExceptionRaceNotFound;
-extern GameExceptionRef GameExceptionBadInsn;
-extern GameExceptionRef GameExceptionBadInsnFormat;
-extern GameExceptionRef GameExceptionSegFault;
-extern GameExceptionRef GameExceptionBadDirection;
+std::string GameExceptionString(GameExceptionRef exc);
+bool        GameExceptionIsFault(GameExceptionRef exc);
 
-static inline const char *GameExceptionString(GameExceptionRef exc) {
-    return exc;
-}
 
+typedef struct GameRandom {
+    uint64_t state = 0;
+    
+    void     seed(uint64_t seed);
+    uint32_t next();
+    uint32_t below(uint32_t bound);
+} GameRandom;
+
+uint64_t GameRandomSeed();
+
+
+static const std::size_t GameTraceLength = 64;
 
-uint32_t GameRandom();
-uint32_t GameRandomBelow(uint32_t i);
+typedef struct GameTraceEntry {
+    int         move;
+    uint32_t    cell;
+    std::size_t pc;
+    long        weight;
+    RaceID      race;
+    uint8_t     op;
+} GameTraceEntry;
+
+
+// Where the starting cells go. Uniform scatters every race over the whole
+// board. Quadrant keeps each race in its own quarter, diagonal ones first.
+// Clustered puts each race in one compact block around a random square.
+// Symmetric scatters the first race over the top left quarter, only on
+// squares whose mirror images are free, and gives the next three those
+// images, facing mirrored directions, so every seat starts from the same
+// position; if the quarter has no room left the game reports a full board.
+typedef enum {
+    GameLayoutUniform,
+    GameLayoutQuadrant,
+    GameLayoutClustered,
+    GameLayoutSymmetric
+} GameLayout;
+static const int GameLayoutCount = GameLayoutSymmetric + 1;
+
+static const int GameLayoutAttempts   = 64;
+static const int GameLayoutSymmetries = 4;
+
+const char *GameLayoutString(GameLayout layout);
+bool        GameLayoutFromString(const std::string &string, GameLayout &layout);
+
+typedef struct GameConfig {
+    int width             = GameBoxWidth;
+    int height            = GameBoxHeight;
+    int initialPopulation = GameInitialPopulation;
+    int moveNumber        = GameMoveNumber;
+    
+    GameLayout layout = GameLayoutUniform;
+    
+    bool stopAtLastSurvivor = false;
+    
+    uint64_t seed = 0;
+} GameConfig;
+
+
+typedef struct GameFault GameFault;
+
+class GameObserver {
+public:
+    virtual ~GameObserver() {}
+    
+    virtual void cellSpawned(Game &game, Race &race, Cell &cell) {}
+    virtual void cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) {}
+    virtual void cellDied(Game &game, Race &race, Cell &cell) {}
+    virtual void cellCloned(Game &game, Race &race, Cell &cell) {}
+    virtual void cellHit(Game &game, Race &race, Cell &cell, Race &enemyRace, Cell &enemy, long damage) {}
+    virtual void raceExtinct(Game &game, Race &race) {}
+    virtual void raceDisqualified(Game &game, Race &race, const GameFault &fault) {}
+    virtual void moveEnded(Game &game) {}
+};
 
 
 typedef enum {
@@ -50,19 +147,20 @@ typedef enum {
     CellInsnRepStr
 } CellInsnRep;
 
-typedef struct Cell {
+struct Cell {
 private:
-    Cell *nearEnemy(Game &game, Race &race);
+    Cell *nearEnemy(Game &game, Race &race, RaceID *enemyRace = nullptr);
 public:
-    CellInsnRep rep    = CellInsnRepEat;
-    int         repCnt = 0;
+    CellInsnRep rep      = CellInsnRepEat;
+    int         repCnt   = 0;
+    uint64_t    repSince = 0;
     
     int x;
     int y;
     
     long weight = 5;
     
-    Direction direction = (Direction)(arc4random() % (DirectionMax + 1));
+    Direction direction = DirectionNorth;
     const char *directionString();
     
     std::size_t pc = 0;
@@ -74,60 +172,137 @@ public:
     void left();
     void right();
     void back();
-    void turn();
+    void turn(Game &game);
     void jg(int m, std::size_t addr);
     void jl(int m, std::size_t addr);
     void j(std::size_t addr);
     void je(Game &game, Race &race, std::size_t addr);
-} Cell;
+};
 
 
 static const int RaceExtinctionDateNone = 0;
 
+typedef struct RaceStats {
+    std::size_t cells   = 0;
+    long        biomass = 0;
+    long        clones  = 0;
+    long        kills   = 0;
+    long        wasted  = 0;
+} RaceStats;
+
+// While a cell repeats eat, its weight and repCnt are left as they were at
+// the pass repSince and each of its turns only advances the round robin;
+// settle() applies the elapsed turns in closed form. Anything that reads a
+// live cell's weight or repeat count from outside its own turn settles it
+// first, or goes through stats() or Game::settle().
 struct Race {
 private:
     std::size_t nextCellIndex = 0;
+    uint64_t    passes        = 0;
 public:
-    UIColor color;
-    const char *colorString();
+    RaceID      id = RaceIDNone;
+    std::string name;
+    std::string path;
     
     bool extinct = false;
     int  extinctionDate = RaceExtinctionDateNone;
+    bool disqualified = false;
     
-    std::vector<std::vector<std::string>> insn;
-    std::vector<std::string> fetchInsn(std::size_t &pc);
+    long clones = 0;
+    long kills  = 0;
+    long wasted = 0;
+    
+    std::size_t living = 0;
+    
+    GameProgramRef program;
+    const GameInsn &fetchInsn(std::size_t &pc);
+    
+    void load(const std::string &path, GameProgramCache *cache = nullptr);
     
     std::vector<Cell> cells;
-    Cell &nextCell();
-    Cell &prevCell();
+    std::size_t nextCell();
+    
+    uint64_t turnsPast(std::size_t index) {return passes + (nextCellIndex > index);}
+    void     settle(Cell &cell);
+    
+    void reset();
+    
+    RaceStats stats();
 };
 
 
+// What a faulting program left behind: the exception, the faulting cell as
+// it was when the fault hit, every race's stats at that moment and the last
+// instructions the game executed, oldest first.
+struct GameFault {
+    GameException               exception;
+    std::size_t                 cellIndex;
+    Cell                        cell;
+    std::vector<RaceStats>      races;
+    std::vector<GameTraceEntry> trace;
+    
+    GameFault(GameExceptionRef exception) : exception(exception) {}
+};
+
+std::string GameFaultString(Game &game, const GameFault &fault);
+
+
 class Game {
 private:
-    UIDisplay *display;
+    GameConfig config;
+    GameRandom rng;
+    GameWorld  world;
+    
+    std::vector<GameObserver *> observers;
     
     std::vector<Race> races;
     std::size_t nextRaceIndex = 0;
     Race &nextRace();
     
-    void removeRaceWithColor(UIColor color);
+    int  move = 0;
+    bool over = false;
+    
+    GameTraceEntry         trace[GameTraceLength];
+    std::size_t            traceCount = 0;
+    std::vector<GameFault> faults;
+    
+    void record(Race &race, std::size_t index, std::size_t pc, uint8_t op, long weight);
+    void disqualify(Race &race, std::size_t index, GameExceptionRef exc);
     
-    int logY = GameBoxHeight + 1;
-    void logLine(std::string &string);
+    bool populated = false;
+    void populate(Race &race);
+    void populateMirrored(std::size_t count);
+    void randomEmptyIn(int left, int top, int width, int height, int &x, int &y);
     
-    void extinctionAlert(const char *colorString);
+    Race &raceStep();
+    void perform(Race &race, Cell &cell, const GameInsn &insn);
+    void endMove();
 public:
-    Game(UIDisplay *display);
+    Game(const GameConfig &config = GameConfig());
+    
+    const GameConfig &getConfig() {return config;}
+    const GameRandom &getRandom() {return rng;}
+    
+    uint32_t random()                    {return rng.next();}
+    uint32_t randomBelow(uint32_t bound) {return rng.below(bound);}
+    
+    void addObserver(GameObserver *observer);
+    void removeObserver(GameObserver *observer);
     
     std::size_t raceCount() {return races.size();};
-    void        addRace(Race &race);
+    Race        &addRace(const Race &race);
+    Race        &addRace(const std::string &name, GameProgramRef program);
     Race        &raceWithIndex(std::size_t index);
-    Race        &raceWithColor(UIColor color);
+    Race        &raceWithID(RaceID id);
     
-    Cell *cellAt(int x, int y, UIColor *color = nullptr);
+    Cell *cellAt(int x, int y, RaceID *race = nullptr);
+    GameWorld &getWorld() {return world;}
     
-    void drawNewCell();
+    void cellSpawned(Race &race, Cell &cell);
+    void cellMoved(Race &race, Cell &cell, int fromX, int fromY);
+    void cellDied(Race &race, Cell &cell);
+    void cellCloned(Race &race, Cell &cell);
+    void cellHit(Race &race, Cell &cell, Race &enemyRace, Cell &enemy, long damage);
     
     void moveIfPossible(int &x, int &y, int dstX, int dstY);
     bool isVisitable(int x, int y);
@@ -135,14 +310,17 @@ public:
     bool isEmpty(int x, int y);
     void randomEmpty(int &x, int &y);
     
-    void log(const char *msg);
-    void log(const std::string &msg);
+    int  currentMove() {return move;}
+    bool isOver()      {return over;}
     
-    void fatal(const char *msg) NORETURN;
-    void fatal(const std::string &msg) NORETURN;
+    const std::vector<GameFault> &getFaults() {return faults;}
     
-    Race &raceStep();
-    void start();
+    void        populate();
+    void        reset(uint64_t seed);
+    void        settle();
+    
+    std::size_t step(std::size_t n = 1);
+    std::size_t runUntil(const std::function<bool(Game &)> &predicate);
 };
 
 
@@ -0,0 +1,200 @@
+#include "heatmap.hpp"
+#include <algorithm>
+#include <string>
+#include <cstring>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+const char *GameHeatString(GameHeat heat) {
+    switch (heat) {
+        case GameHeatOccupancy:
+            return "occupancy";
+        case GameHeatDeaths:
+            return "deaths";
+        case GameHeatHits:
+            return "hits";
+        case GameHeatClones:
+            return "clones";
+    }
+    
+    return "unknown";
+}
+
+
+GameHeatmap::GameHeatmap(Game &game, int scale) {
+    width  = game.getConfig().width;
+    height = game.getConfig().height;
+    
+    if (scale <= 0)
+        scale = (std::max(width, height) + GameHeatmapAutoBins - 1) / GameHeatmapAutoBins;
+    
+    this->scale = std::max(1, scale);
+    columns = (width  + this->scale - 1) / this->scale;
+    rows    = (height + this->scale - 1) / this->scale;
+    layers  = 1 + (int)game.raceCount();
+    
+    counts.assign((size_t)layers * GameHeatCount * rows * columns, 0);
+    
+    for (size_t i = 0; i < game.raceCount(); i++)
+        for (Cell &cell : game.raceWithIndex(i).cells)
+            if (cell.weight > 0)
+                occupy(cell.x, cell.y, game.currentMove());
+}
+
+uint64_t &GameHeatmap::count(int layer, GameHeat heat, int x, int y) {
+    return counts[(((size_t)layer * GameHeatCount + heat) * rows + y / scale) * columns + x / scale];
+}
+
+void GameHeatmap::add(RaceID race, GameHeat heat, int x, int y, uint64_t n) {
+    count(0, heat, x, y) += n;
+    
+    if (race < layers - 1)
+        count(1 + race, heat, x, y) += n;
+}
+
+void GameHeatmap::occupy(int x, int y, int move) {
+    since[(int64_t)y * width + x] = move;
+}
+
+void GameHeatmap::vacate(RaceID race, int x, int y, int move) {
+    auto square = since.find((int64_t)y * width + x);
+    if (square == since.end())
+        return;
+    
+    add(race, GameHeatOccupancy, x, y, move - square->second);
+    since.erase(square);
+}
+
+void GameHeatmap::cellSpawned(Game &game, Race &race, Cell &cell) {
+    occupy(cell.x, cell.y, game.currentMove());
+}
+
+void GameHeatmap::cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) {
+    vacate(race.id, fromX, fromY, game.currentMove());
+    occupy(cell.x, cell.y, game.currentMove());
+}
+
+void GameHeatmap::cellDied(Game &game, Race &race, Cell &cell) {
+    vacate(race.id, cell.x, cell.y, game.currentMove());
+    add(race.id, GameHeatDeaths, cell.x, cell.y, 1);
+}
+
+void GameHeatmap::cellCloned(Game &game, Race &race, Cell &cell) {
+    add(race.id, GameHeatClones, cell.x, cell.y, 1);
+}
+
+void GameHeatmap::cellHit(Game &game, Race &race, Cell &cell, Race &enemyRace, Cell &enemy, long damage) {
+    add(race.id, GameHeatHits, enemy.x, enemy.y, 1);
+}
+
+void GameHeatmap::settle(Game &game) {
+    for (auto &square : since) {
+        int x = (int)(square.first % width);
+        int y = (int)(square.first / width);
+        
+        RaceID race = RaceIDNone;
+        if (game.cellAt(x, y, &race))
+            add(race, GameHeatOccupancy, x, y, game.currentMove() - square.second);
+    }
+    
+    since.clear();
+}
+
+void GameHeatmap::clear() {
+    std::fill(counts.begin(), counts.end(), 0);
+    since.clear();
+}
+
+bool GameHeatmap::merge(const GameHeatmap &other) {
+    if (!layers) {
+        *this = other;
+        since.clear();
+        return true;
+    }
+    
+    if (other.columns != columns || other.rows != rows ||
+        other.scale != scale || other.layers != layers)
+        return false;
+    
+    for (size_t i = 0; i < counts.size(); i++)
+        counts[i] += other.counts[i];
+    
+    return true;
+}
+
+uint64_t GameHeatmap::at(GameHeat heat, int x, int y, RaceID race) {
+    int layer = race == RaceIDNone ? 0 : 1 + race;
+    if (layer >= layers)
+        return 0;
+    
+    return count(layer, heat, x, y);
+}
+
+void GameHeatmap::write(string &data) {
+    int32_t header[4] = {columns, rows, scale, layers};
+    
+    data.assign("GODHEAT1", 8);
+    data.append((const char *)header, sizeof(header));
+    data.append((const char *)counts.data(), counts.size() * sizeof(uint64_t));
+}
+
+bool GameHeatmap::read(const string &data) {
+    int32_t header[4];
+    if (data.size() < 8 + sizeof(header) || data.compare(0, 8, "GODHEAT1"))
+        return false;
+    
+    std::memcpy(header, data.data() + 8, sizeof(header));
+    if (header[0] <= 0 || header[1] <= 0 || header[2] <= 0 || header[3] <= 0)
+        return false;
+    
+    size_t payload = (data.size() - 8 - sizeof(header)) / sizeof(uint64_t);
+    size_t size    = (size_t)header[3] * GameHeatCount;
+    for (int i = 1; i >= 0 && size <= payload; i--)
+        size *= header[i];
+    
+    if (size != payload || data.size() != 8 + sizeof(header) + size * sizeof(uint64_t))
+        return false;
+    
+    columns = header[0];
+    rows    = header[1];
+    scale   = header[2];
+    layers  = header[3];
+    width   = columns * scale;
+    height  = rows * scale;
+    
+    counts.resize(size);
+    std::memcpy(counts.data(), data.data() + 8 + sizeof(header), size * sizeof(uint64_t));
+    since.clear();
+    
+    return true;
+}
+
+void GameHeatmap::write(std::FILE *file, bool binary) {
+    if (binary) {
+        string data;
+        write(data);
+        std::fwrite(data.data(), 1, data.size(), file);
+        return;
+    }
+    
+    for (int layer = 0; layer < layers; layer++)
+        for (int heat = 0; heat < GameHeatCount; heat++) {
+            string text = string("# ") + GameHeatString((GameHeat)heat) + " " +
+                          (layer ? "race " + to_string(layer - 1) : "all") + "\n";
+            
+            for (int y = 0; y < rows; y++) {
+                for (int x = 0; x < columns; x++) {
+                    if (x)
+                        text += ' ';
+                    text += to_string(count(layer, (GameHeat)heat, x * scale, y * scale));
+                }
+                
+                text += '\n';
+            }
+            
+            std::fwrite(text.data(), 1, text.size(), file);
+        }
+}
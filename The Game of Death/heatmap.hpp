@@ -0,0 +1,65 @@
+#ifndef HEATMAP_HPP
+#define HEATMAP_HPP
+
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "game.hpp"
+
+
+typedef enum {
+    GameHeatOccupancy,
+    GameHeatDeaths,
+    GameHeatHits,
+    GameHeatClones
+} GameHeat;
+static const int GameHeatCount = GameHeatClones + 1;
+
+static const int GameHeatmapAutoBins = 256;
+
+const char *GameHeatString(GameHeat heat);
+
+class GameHeatmap : public GameObserver {
+private:
+    int width   = 0;
+    int height  = 0;
+    int scale   = 1;
+    int columns = 0;
+    int rows    = 0;
+    int layers  = 0;
+    
+    std::vector<uint64_t> counts;
+    
+    std::unordered_map<int64_t, int> since;
+    
+    uint64_t &count(int layer, GameHeat heat, int x, int y);
+    void      add(RaceID race, GameHeat heat, int x, int y, uint64_t n);
+    
+    void occupy(int x, int y, int move);
+    void vacate(RaceID race, int x, int y, int move);
+public:
+    GameHeatmap() {}
+    GameHeatmap(Game &game, int scale = 0);
+    
+    void cellSpawned(Game &game, Race &race, Cell &cell) override;
+    void cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) override;
+    void cellDied(Game &game, Race &race, Cell &cell) override;
+    void cellCloned(Game &game, Race &race, Cell &cell) override;
+    void cellHit(Game &game, Race &race, Cell &cell, Race &enemyRace, Cell &enemy, long damage) override;
+    
+    void settle(Game &game);
+    void clear();
+    bool merge(const GameHeatmap &other);
+    
+    uint64_t at(GameHeat heat, int x, int y, RaceID race = RaceIDNone);
+    
+    void write(std::FILE *file, bool binary);
+    void write(std::string &data);
+    bool read(const std::string &data);
+};
+
+
+#endif
@@ -4,130 +4,407 @@
  */
 
 #include <cstdlib>
-#include <fstream>
+#include <cstdio>
 #include <string>
-#include <algorithm>
-#include <cctype>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <vector>
 #include <csignal>
 #include "game.hpp"
+#include "program.hpp"
+#include "view.hpp"
+#include "control.hpp"
+#include "stats.hpp"
+#include "heatmap.hpp"
+#include "spectator.hpp"
+#include "recorder.hpp"
+#include "batch.hpp"
 
 #if UI_USE_NCURSES
 #include "ncui.hpp"
+#elif UI_USE_ANSI
+#include "ansiui.hpp"
 #else
 #error "No UI backend selected!"
 #endif
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#define NORETURN __attribute__((__noreturn__))
+#else
+#define NORETURN
+#endif
+
 using std::size_t;
 using std::string;
 using std::to_string;
 
 
+static bool headless = false;
+
+static UIDisplay  *gameDisplay = nullptr;
+static UIRecorder *recorder    = nullptr;
+
+
 static void onSIGINT(int sig) {
+    if (headless)
+        exit(0);
+    
+    GameControl::interrupted = 1;
+}
+
+// Registered after UIQuit so it runs first on every way out: the last
+// screen goes into the recording, and the recorder drains its queue and
+// joins its thread while stdio is still up.
+static void closeDisplay() {
+    if (recorder) {
+        gameDisplay->flush();
+        gameDisplay->setRecorder(nullptr);
+        
+        delete recorder;
+        recorder = nullptr;
+    }
+    
+    delete gameDisplay;
+    gameDisplay = nullptr;
+}
+
+static void usage() {
+    fputs("Usage: death [-q] [-s seed] [-m moves] [-b WxH] [-p cells] [-L layout] [-t file [-i n]] [-H file] [-w addr] [-r file] [-R rate] [-g games [-j n]] <program1 program2 ...>\n"
+          "Each program is a path to a compiled race program. A name without\n"
+          "an extension like \"red\" is looked up as red.dasm.\n"
+          "Races are colored by their position on the command line.\n"
+          "  -q       run without the terminal UI and print the log to stdout\n"
+          "  -s seed  seed the game's random generator (0 picks one)\n"
+          "  -m moves stop after this many moves\n"
+          "  -b WxH   board size in squares, sparse storage is used for huge boards\n"
+          "  -p cells starting cells per race\n"
+          "  -L name  starting layout: uniform, quadrant, clustered or symmetric (uniform)\n"
+          "  -t file  record per-race statistics to file (.csv for CSV, else binary)\n"
+          "  -i n     sample statistics every n moves (100)\n"
+          "  -H file  write occupancy, death, hit and clone heatmaps (.txt for text, else binary)\n"
+          "  -w addr  stream the board to deathwatch clients on a local port or Unix socket path\n"
+          "  -r file  record the terminal UI to file (.cast for asciicast, else raw ANSI)\n"
+          "  -R rate  moves per second in the terminal UI (0 for as fast as possible)\n"
+          "  -g games with -q, play this many games on consecutive seeds, each until one race is left\n"
+          "  -j n     threads for -g (one per core)\n",
+          stderr);
+}
+
+static bool writeHeatmap(GameHeatmap &heatmap, const string &path) {
+    bool text = path.length() > 4 && path.substr(path.length() - 4) == ".txt";
+    
+    std::FILE *file = std::fopen(path.c_str(), text ? "w" : "wb");
+    if (!file)
+        return false;
+    
+    heatmap.write(file, !text);
+    std::fclose(file);
+    return true;
+}
+
+static bool runBatch(Game &game, size_t games, size_t threads, const string &heatmapPath) {
+    GameConfig config = game.getConfig();
+    config.stopAtLastSurvivor = true;
+    
+    GameBatch batch(config, threads);
+    for (size_t i = 0; i < game.raceCount(); i++)
+        batch.addRace(game.raceWithIndex(i).name, game.raceWithIndex(i).program);
+    
+    if (heatmapPath.length())
+        batch.recordHeatmaps();
+    
+    size_t races = game.raceCount();
+    std::vector<long> biomass(games * races, -1);
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    batch.run(games, [&config](size_t match) {
+        return config.seed + match ? config.seed + match : 1;
+    }, [&biomass, races](size_t match, Game &game) {
+        for (size_t i = 0; i < races; i++) {
+            Race &race = game.raceWithIndex(i);
+            if (!race.extinct)
+                biomass[match * races + i] = race.stats().biomass;
+        }
+    });
+    
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "%zu games in %.2f s, %.0f per second\n", games, elapsed.count(), games / elapsed.count());
+    
+    std::vector<size_t> wins(races), survivals(races);
+    std::vector<long>   total(races);
+    for (size_t match = 0; match < games; match++) {
+        const long *result = &biomass[match * races];
+        
+        size_t winner = races;
+        for (size_t i = 0; i < races; i++) {
+            if (result[i] < 0)
+                continue;
+            
+            survivals[i]++;
+            total[i] += result[i];
+            if (winner == races || result[i] > result[winner])
+                winner = i;
+        }
+        
+        if (winner < races)
+            wins[winner]++;
+    }
+    
+    if (heatmapPath.length() && !writeHeatmap(batch.getHeatmap(), heatmapPath))
+        return false;
+    
+    for (size_t i = 0; i < races; i++)
+        printf("- %s: won %zu, survived %zu, average biomass weight = %ld.\n",
+               game.raceWithIndex(i).name.c_str(), wins[i], survivals[i], total[i] / (long)games);
+    
+    return true;
+}
+
+static void fatal(GameView &view, const string &msg) NORETURN;
+static void fatal(GameView &view, const string &msg) {
+    if (headless) {
+        view.syncLog();
+        fprintf(stderr, "%s\n", msg.c_str());
+        exit(1);
+    }
+    
+    view.log(msg);
+    
+    while (!GameControl::interrupted)
+#ifndef _WIN32
+        pause();
+#else
+        std::this_thread::yield();
+#endif
+    
     exit(0);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fputs("Usage: death <color1 color2 ...>\n"
-              "The game will search for corresponding program files for each color like COLOR.dasm\n"
-              "Allowed colors: green, red, yellow, blue.\n",
-              stderr);
+    GameConfig config;
+    
+    string statsPath;
+    int    statsInterval = GameStatsDefaultInterval;
+    
+    string heatmapPath;
+    string spectatorAddress;
+    string recordPath;
+    double rate = GameMoveRate;
+    
+    size_t batchGames   = 0;
+    size_t batchThreads = std::thread::hardware_concurrency();
+    
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        string option(argv[argi]);
+        if (option == "-q")
+            headless = true;
+        else if (option == "-s" && argi + 1 < argc)
+            config.seed = std::strtoull(argv[++argi], nullptr, 0);
+        else if (option == "-m" && argi + 1 < argc)
+            config.moveNumber = std::atoi(argv[++argi]);
+        else if (option == "-b" && argi + 1 < argc) {
+            if (std::sscanf(argv[++argi], "%dx%d", &config.width, &config.height) != 2 ||
+                config.width <= 0 || config.height <= 0) {
+                usage();
+                return 1;
+            }
+        } else if (option == "-p" && argi + 1 < argc)
+            config.initialPopulation = std::atoi(argv[++argi]);
+        else if (option == "-L" && argi + 1 < argc) {
+            if (!GameLayoutFromString(argv[++argi], config.layout)) {
+                usage();
+                return 1;
+            }
+        } else if (option == "-t" && argi + 1 < argc)
+            statsPath = argv[++argi];
+        else if (option == "-i" && argi + 1 < argc)
+            statsInterval = std::atoi(argv[++argi]);
+        else if (option == "-H" && argi + 1 < argc)
+            heatmapPath = argv[++argi];
+        else if (option == "-w" && argi + 1 < argc)
+            spectatorAddress = argv[++argi];
+        else if (option == "-r" && argi + 1 < argc)
+            recordPath = argv[++argi];
+        else if (option == "-R" && argi + 1 < argc)
+            rate = std::atof(argv[++argi]);
+        else if (option == "-g" && argi + 1 < argc)
+            batchGames = std::strtoul(argv[++argi], nullptr, 0);
+        else if (option == "-j" && argi + 1 < argc)
+            batchThreads = std::strtoul(argv[++argi], nullptr, 0);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    
+    if (argi >= argc || (headless && recordPath.length()) ||
+        (batchGames && (!headless || statsPath.length() || spectatorAddress.length()))) {
+        usage();
         return 1;
     }
     
+    std::FILE *recordFile = nullptr;
+    if (recordPath.length()) {
+        recordFile = std::fopen(recordPath.c_str(), "wb");
+        if (!recordFile) {
+            fprintf(stderr, "Write failed: %s\n", recordPath.c_str());
+            return 1;
+        }
+    }
+    
     std::signal(SIGINT, onSIGINT);
     
-    UIInit();
-    std::atexit(UIQuit);
+    if (!headless) {
+        UIInit();
+        std::atexit(UIQuit);
+        
+        gameDisplay = new UIDisplay(0, 0, -1, -1);
+        std::atexit(closeDisplay);
+        
+        if (recordFile) {
+            bool cast = recordPath.length() > 5 && recordPath.substr(recordPath.length() - 5) == ".cast";
+            
+            recorder = new UIRecorder(recordFile, cast ? UIRecordCast : UIRecordANSI,
+                                      gameDisplay->getWidth(), gameDisplay->getHeight());
+            gameDisplay->setRecorder(recorder);
+        }
+    }
+    
+    Game game(config);
+    
+    GameView view(gameDisplay, game.getConfig());
+    game.addObserver(&view);
     
-    UIDisplay gameDisplay(0, 0, -1, -1);
+    if (headless)
+        view.log("Seed: " + to_string(game.getConfig().seed));
     
-    Game game(&gameDisplay);
+    if ((size_t)(argc - argi) > RaceCountMax)
+        fatal(view, "Too many races!");
     
-    for (int i = 1; i < argc; i++) {
+    GameProgramCache programs;
+    
+    for (int i = argi; i < argc; i++) {
         Race race;
         
-        string colorString(argv[i]);
-        if (colorString == "green")
-            race.color = UIColorGreen;
-        else if (colorString == "red")
-            race.color = UIColorRed;
-        else if (colorString == "yellow")
-            race.color = UIColorYellow;
-        else if (colorString == "blue")
-            race.color = UIColorBlue;
-        else
-            game.fatal("Illegal color \"" + colorString + "\"!");
+        string fn(argv[i]);
+        size_t slash = fn.rfind('/');
+        size_t dot   = fn.rfind('.');
+        if (dot == fn.npos || (slash != fn.npos && dot < slash))
+            fn += ".dasm";
         
-        string fn(colorString + ".dasm");
-        std::ifstream code(fn);
-        if (code.fail())
-            game.fatal("Read failed: " + fn);
+        try {
+            race.load(fn, &programs);
+            game.addRace(race);
+        } catch (GameExceptionRef exc) {
+            fatal(view, GameExceptionString(exc));
+        }
+    }
+    
+    if (batchGames) {
+        try {
+            if (!runBatch(game, batchGames, batchThreads, heatmapPath))
+                fatal(view, "Write failed: " + heatmapPath);
+        } catch (GameExceptionRef exc) {
+            fatal(view, GameExceptionString(exc));
+        }
         
-        string line;
-        while (std::getline(code, line)) {
-            std::vector<string> insn;
-            size_t i = 0;
-            while (true) {
-                string s;
-                size_t spc = line.find(' ', i);
-                if (spc == s.npos)
-                    s = string(line, i);
-                else
-                    s = string(line, i, spc - i);
-                
-                if (s.length())
-                    insn.push_back(s);
-                
-                if (spc == s.npos)
-                    break;
-                
-                i = spc + 1;
-            }
-
-            if (insn.size())
-                race.insn.push_back(insn);
+        return 0;
+    }
+    
+    try {
+        game.populate();
+    } catch (GameExceptionRef exc) {
+        fatal(view, GameExceptionString(exc));
+    }
+    
+    std::unique_ptr<GameHeatmap> heatmap;
+    if (heatmapPath.length()) {
+        heatmap.reset(new GameHeatmap(game));
+        game.addObserver(heatmap.get());
+    }
+    
+    std::unique_ptr<GameSpectatorServer> spectator;
+    if (spectatorAddress.length()) {
+        try {
+            spectator.reset(new GameSpectatorServer(game, spectatorAddress));
+        } catch (GameExceptionRef exc) {
+            fatal(view, GameExceptionString(exc));
         }
         
-        game.addRace(race);
+        game.addObserver(spectator.get());
+    }
+    
+    std::FILE *statsFile = nullptr;
+    std::unique_ptr<GameStatsRecorder> stats;
+    if (statsPath.length()) {
+        bool csv = statsPath.length() > 4 && statsPath.substr(statsPath.length() - 4) == ".csv";
+        
+        statsFile = std::fopen(statsPath.c_str(), csv ? "w" : "wb");
+        if (!statsFile)
+            fatal(view, "Write failed: " + statsPath);
+        
+        stats.reset(new GameStatsRecorder(game, statsFile, csv ? GameStatsCSV : GameStatsBinary, statsInterval));
+        game.addObserver(stats.get());
     }
     
     try {
-        game.start();
+        if (headless) {
+            while (!game.isOver())
+                game.step(1024);
+        } else {
+            GameControl control(game, view, rate);
+            if (!control.run())
+                return 0;
+        }
     } catch (GameExceptionRef exc) {
-        game.fatal(GameExceptionString(exc));
+        fatal(view, GameExceptionString(exc));
     }
     
-    game.log("=========================Finish==========================\n"
+    if (spectator)
+        spectator->finish(game);
+    
+    if (stats) {
+        stats->finish();
+        std::fclose(statsFile);
+    }
+    
+    if (heatmap) {
+        heatmap->settle(game);
+        if (!writeHeatmap(*heatmap, heatmapPath))
+            fatal(view, "Write failed: " + heatmapPath);
+    }
+    
+    view.log("=========================Finish==========================\n"
              "Results:");
-    UIAttention();
+    if (!headless)
+        UIAttention();
     
-    for (int i = 0; i < argc - 1; i++) {
+    for (size_t i = 0; i < game.raceCount(); i++) {
         Race &race = game.raceWithIndex(i);
         
-        if (race.color == UIColorBlue) {
-            for (Cell &cell : race.cells)
-                if (cell.weight > 0)
-                    game.log("alive blue cell @ " + to_string(cell.x) + "," + to_string(cell.y));
-        }
-        
-        string result = string("- ") + race.colorString() + ": ";
+        string result = "- " + race.name + ": ";
         
-        if (race.extinct)
+        if (race.disqualified)
+            result += "disqualified in move " + to_string(race.extinctionDate) + ".";
+        else if (race.extinct)
             result += "extinct after move " + to_string(race.extinctionDate) + ".";
-        else {
-            long weightSum = 0;
-            for (Cell &cell : race.cells)
-                if (cell.weight > 0)
-                    weightSum += cell.weight;
-            
-            result += "alive with total biomass weight = " + to_string(weightSum) + ".";
-        }
+        else
+            result += "alive with total biomass weight = " + to_string(race.stats().biomass) + ".";
         
-        game.log(result);
+        view.log(result);
     }
     
-    game.fatal("Stop.");
+    if (headless)
+        return 0;
+    
+    fatal(view, "Stop.");
     
     return 0;
 }
@@ -1,11 +1,28 @@
+#if UI_USE_NCURSES
+
 #include "ncui.hpp"
+#include "recorder.hpp"
 #include <cstring>
+#include <poll.h>
+#include <unistd.h>
 
 using std::memcpy;
+using std::to_string;
 
 
 static std::mutex ncursesMutex;
 
+static const short UIColorValues[] = {
+    COLOR_BLACK,
+    COLOR_GREEN,
+    COLOR_RED,
+    COLOR_YELLOW,
+    COLOR_BLUE,
+    COLOR_MAGENTA,
+    COLOR_CYAN,
+    COLOR_WHITE
+};
+
 
 UIDisplay::UIDisplay(int x, int y, int width, int height, bool autoFlush) {
     this->x = x;
@@ -32,7 +49,9 @@ UIDisplay::UIDisplay(int x, int y, int width, int height, bool autoFlush) {
 
 UIDisplay::~UIDisplay() {
     setAutoFlush(false);
-    autoFlushThread.join();
+    
+    if (autoFlushThread.joinable())
+        autoFlushThread.join();
 }
 
 int UIDisplay::getWidth() {
@@ -67,6 +86,7 @@ void UIDisplay::putString(int x, int y, const char *string, chtype attr) {
     }
     
     updateMutex.unlock();
+    requestFlush();
 }
 
 void UIDisplay::putString(int x, int y, std::string &string, chtype attr) {
@@ -80,6 +100,7 @@ void UIDisplay::eraseLine(int y) {
         update[y * width + x] = ' ';
     
     updateMutex.unlock();
+    requestFlush();
 }
 
 void UIDisplay::copyLine(int dstY, int srcY) {
@@ -88,12 +109,20 @@ void UIDisplay::copyLine(int dstY, int srcY) {
     std::memcpy(update + dstY * width, update + srcY * width, sizeof(chtype) * width);
     
     updateMutex.unlock();
+    requestFlush();
 }
 
 void UIDisplay::flush() {
     ncursesMutex.lock();
     updateMutex.lock();
     
+    if (flushHandler)
+        flushHandler();
+    
+    bool recordDiff = recorder && !recordAll;
+    if (recorder && recordAll)
+        recordScreen();
+    
     chtype *s = screen;
     chtype *u = update;
     for (int y1 = 0; y1 < height; y1++) {
@@ -101,27 +130,129 @@ void UIDisplay::flush() {
             if (*s != *u) {
                 mvaddch(y + y1, x + x1, *u);
                 *s = *u;
+                
+                if (recordDiff)
+                    recordChar(x1, y1, *u);
             }
         }
     }
     
+    if (recorder && !recordBuffer.empty())
+        recordAll = !recorder->record(recordBuffer);
+    
     ncursesMutex.unlock();
     updateMutex.unlock();
     
     refresh();
+    
+    if (recordDiff && recordAll)
+        requestFlush();
+}
+
+void UIDisplay::requestFlush() {
+    if (flushPending.load(std::memory_order_relaxed) || flushPending.exchange(true))
+        return;
+    
+    std::lock_guard<std::mutex> lock(flushMutex);
+    flushReady.notify_one();
 }
 
 void UIDisplay::setAutoFlush(bool value) {
-    if (value && value != autoFlush)
+    if (value && value != autoFlush) {
+        if (autoFlushThread.joinable())
+            autoFlushThread.join();
+        
+        autoFlush = value;
         autoFlushThread = std::thread(&UIDisplay::flushLoop, this);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        autoFlush = value;
+    }
+    
+    flushReady.notify_one();
+}
+
+void UIDisplay::setFrameRate(int fps) {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    frameRate = fps > 0 ? fps : UIFrameRate;
+}
+
+void UIDisplay::setFlushHandler(const std::function<void()> &handler) {
+    updateMutex.lock();
+    flushHandler = handler;
+    updateMutex.unlock();
+}
+
+void UIDisplay::setRecorder(UIRecorder *recorder) {
+    updateMutex.lock();
+    this->recorder = recorder;
+    recordAll = true;
+    updateMutex.unlock();
+}
+
+void UIDisplay::recordChar(int x, int y, chtype ch) {
+    x += this->x;
+    y += this->y;
+    
+    if (x != recordX || y != recordY)
+        recordBuffer += "\x1b[" + to_string(y + 1) + ";" + to_string(x + 1) + "H";
+    
+    chtype attr = ch & A_COLOR;
+    if (attr != recordAttr) {
+        if (PAIR_NUMBER(attr))
+            recordBuffer += "\x1b[" + to_string(30 + UIColorValues[PAIR_NUMBER(attr)]) + "m";
+        else
+            recordBuffer += "\x1b[0m";
+        
+        recordAttr = attr;
+    }
+    
+    char text = ch & A_CHARTEXT;
+    recordBuffer += text ? text : ' ';
     
-    autoFlush = value;
+    recordX = x + 1 < getmaxx(stdscr) ? x + 1 : -1;
+    recordY = y;
+}
+
+void UIDisplay::recordScreen() {
+    recordBuffer += "\x1b[?25l\x1b[0m\x1b[H\x1b[2J";
+    recordX    = 0;
+    recordY    = 0;
+    recordAttr = 0;
+    
+    for (int y1 = 0; y1 < height; y1++)
+        for (int x1 = 0; x1 < width; x1++) {
+            chtype ch = update[y1 * width + x1];
+            if ((ch & A_CHARTEXT) && (ch & A_CHARTEXT) != ' ')
+                recordChar(x1, y1, ch);
+        }
 }
 
 void UIDisplay::flushLoop() {
-    while (autoFlush) {
+    auto last = std::chrono::steady_clock::now();
+    
+    std::unique_lock<std::mutex> lock(flushMutex);
+    while (true) {
+        flushReady.wait(lock, [this]() {
+            return flushPending || !autoFlush;
+        });
+        
+        if (!autoFlush)
+            break;
+        
+        auto next = last + std::chrono::microseconds(1000000 / frameRate);
+        lock.unlock();
+        
+        std::this_thread::sleep_until(next);
+        
+        flushPending = false;
         flush();
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        last = std::chrono::steady_clock::now();
+        
+        lock.lock();
     }
 }
 
@@ -135,16 +266,27 @@ void UIInit() {
     clear();
     
     start_color();
-    init_pair(UIColorGreen,  COLOR_GREEN,  COLOR_BLACK);
-    init_pair(UIColorRed,    COLOR_RED,    COLOR_BLACK);
-    init_pair(UIColorYellow, COLOR_YELLOW, COLOR_BLACK);
-    init_pair(UIColorBlue,   COLOR_BLUE,   COLOR_BLACK);
+    for (int color = UIColorGreen; color <= UIColorCount; color++)
+        init_pair(color, UIColorValues[color], COLOR_BLACK);
 }
 
 void UIQuit() {
     endwin();
 }
 
+int UIReadKey() {
+    ncursesMutex.lock();
+    int key = getch();
+    ncursesMutex.unlock();
+    
+    return key;
+}
+
+bool UIWaitKey(int timeout) {
+    pollfd input = {STDIN_FILENO, POLLIN, 0};
+    return poll(&input, 1, timeout) > 0;
+}
+
 void UIBeep() {
     beep();
 }
@@ -157,3 +299,5 @@ void UIAttention() {
     UIBeep();
     UIFlash();
 }
+
+#endif
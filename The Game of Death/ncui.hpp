@@ -2,32 +2,51 @@
 #define NCUI_HPP
 
 
+#include <cstddef>
 #include <string>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <ncurses.h>
 
 
 typedef chtype UIChar;
 
+static const int UIFrameRate = 30;
+
+class UIRecorder;
+
 typedef enum {
     UIColorGreen = 1,
     UIColorRed,
     UIColorYellow,
-    UIColorBlue
+    UIColorBlue,
+    UIColorMagenta,
+    UIColorCyan,
+    UIColorWhite
 } UIColor;
+static const int UIColorCount = UIColorWhite;
 
 typedef enum {
-    UIColorAttrGreen  = COLOR_PAIR(UIColorGreen),
-    UIColorAttrRed    = COLOR_PAIR(UIColorRed),
-    UIColorAttrYellow = COLOR_PAIR(UIColorYellow),
-    UIColorAttrBlue   = COLOR_PAIR(UIColorBlue)
+    UIColorAttrGreen   = COLOR_PAIR(UIColorGreen),
+    UIColorAttrRed     = COLOR_PAIR(UIColorRed),
+    UIColorAttrYellow  = COLOR_PAIR(UIColorYellow),
+    UIColorAttrBlue    = COLOR_PAIR(UIColorBlue),
+    UIColorAttrMagenta = COLOR_PAIR(UIColorMagenta),
+    UIColorAttrCyan    = COLOR_PAIR(UIColorCyan),
+    UIColorAttrWhite   = COLOR_PAIR(UIColorWhite)
 } UIColorAttr;
 
 static inline UIColorAttr UIAttrForColor(UIColor color) {
     return (UIColorAttr)COLOR_PAIR(color);
 }
 
+static inline UIColor UIColorForIndex(std::size_t index) {
+    return (UIColor)(index % UIColorCount + 1);
+}
+
 
 class UIDisplay {
 private:
@@ -44,6 +63,22 @@ private:
     bool        autoFlush;
     std::thread autoFlushThread;
     void        flushLoop();
+    
+    int                     frameRate = UIFrameRate;
+    std::mutex              flushMutex;
+    std::condition_variable flushReady;
+    std::atomic<bool>       flushPending{true};
+    
+    std::function<void()> flushHandler;
+    
+    UIRecorder *recorder  = nullptr;
+    bool        recordAll = false;
+    std::string recordBuffer;
+    int         recordX;
+    int         recordY;
+    chtype      recordAttr;
+    void        recordChar(int x, int y, chtype ch);
+    void        recordScreen();
 public:
     UIDisplay(int x, int y, int width, int height, bool autoFlush = true);
     ~UIDisplay();
@@ -61,7 +96,11 @@ public:
     void copyLine(int dstY, int srcY);
     
     void flush();
+    void requestFlush();
     void setAutoFlush(bool value);
+    void setFrameRate(int fps);
+    void setFlushHandler(const std::function<void()> &handler);
+    void setRecorder(UIRecorder *recorder);
 };
 
 
@@ -71,5 +110,11 @@ void UIBeep();
 void UIFlash();
 void UIAttention();
 
+static const int UIKeyNone      = ERR;
+static const int UIKeyEnter     = KEY_ENTER;
+static const int UIKeyBackspace = KEY_BACKSPACE;
+int UIReadKey();
+bool UIWaitKey(int timeout);
+
 
 #endif
@@ -0,0 +1,42 @@
+#include "pacer.hpp"
+#include <cmath>
+
+
+GamePacer::GamePacer(double rate) {
+    this->rate = rate;
+    reset();
+}
+
+void GamePacer::setRate(double rate) {
+    this->rate = rate;
+    reset();
+}
+
+void GamePacer::reset() {
+    start = Clock::now();
+    moves = 0;
+}
+
+uint64_t GamePacer::due() {
+    if (!isLimited())
+        return 0;
+    
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    
+    uint64_t target = (uint64_t)(elapsed.count() * rate);
+    uint64_t lag    = (uint64_t)std::ceil(GamePacerMaxLag * rate);
+    if (target > moves + lag)
+        moves = target - lag;
+    
+    return target > moves ? target - moves : 0;
+}
+
+int GamePacer::millisecondsUntilDue() {
+    if (!isLimited())
+        return 0;
+    
+    std::chrono::duration<double> next((moves + 1) / rate);
+    std::chrono::duration<double> wait = start + std::chrono::duration_cast<Clock::duration>(next) - Clock::now();
+    
+    return wait.count() > 0 ? (int)std::ceil(wait.count() * 1000) : 0;
+}
@@ -0,0 +1,36 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+
+
+#include <cstdint>
+#include <chrono>
+
+
+static const double GamePacerMaxLag = 0.25;
+
+// Meters out moves to hold a target rate in moves per second. Moves are
+// scheduled against an absolute start time so rounding never drifts, and a
+// pacer that falls more than GamePacerMaxLag seconds behind drops the
+// backlog instead of bursting to catch up. A rate of 0 means unlimited.
+class GamePacer {
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    double            rate;
+    Clock::time_point start;
+    uint64_t          moves = 0;
+public:
+    GamePacer(double rate = 0);
+    
+    double getRate()   {return rate;}
+    bool   isLimited() {return rate > 0;}
+    void   setRate(double rate);
+    void   reset();
+    
+    uint64_t due();
+    void     advance(uint64_t n) {moves += n;}
+    int      millisecondsUntilDue();
+};
+
+
+#endif
@@ -0,0 +1,337 @@
+#include "program.hpp"
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <sys/stat.h>
+
+using std::size_t;
+using std::vector;
+using std::string;
+using std::stoi;
+using std::stol;
+using std::stoul;
+
+
+static const char *const GameOpStrings[] = {
+    "eat",
+    "go",
+    "clon",
+    "str",
+    "left",
+    "right",
+    "back",
+    "turn",
+    "jg",
+    "jl",
+    "j",
+    "je"
+};
+
+const char *GameOpString(GameOp op) {
+    if (op > GameOpMax)
+        return "bad";
+    
+    return GameOpStrings[op];
+}
+
+static GameInsn badInsn(GameError error) {
+    GameInsn insn;
+    insn.op    = GameOpBad;
+    insn.error = error;
+    return insn;
+}
+
+GameInsn GameProgram::decode(const vector<string> &words) {
+    GameInsn insn;
+    
+    for (int op = 0; op <= GameOpMax; op++)
+        if (words[0] == GameOpStrings[op]) {
+            insn.op = (GameOp)op;
+            break;
+        }
+    
+    switch (insn.op) {
+        case GameOpEat:
+        case GameOpGo:
+        case GameOpStr:
+        case GameOpLeft:
+        case GameOpRight:
+            if (words.size() == 2) {
+                if (words[1] == "r") {
+                    if (insn.op != GameOpEat &&
+                        insn.op != GameOpGo)
+                        return badInsn(GameErrorBadInsnFormat);
+                
+                    insn.random = true;
+                } else {
+                    try {
+                        insn.count = stoi(words[1], nullptr, 0);
+                    } catch (...) {
+                        insn.count = -1;
+                    }
+                
+                    if (insn.count < 2 || insn.count > 99)
+                        return badInsn(GameErrorBadInsnFormat);
+                }
+            } else if (words.size() > 2)
+                return badInsn(GameErrorBadInsnFormat);
+            break;
+        case GameOpClon:
+        case GameOpBack:
+            break;
+        case GameOpTurn:
+            if (words.size() != 2 ||
+                words[1] != "r")
+                return badInsn(GameErrorBadInsnFormat);
+        
+            insn.random = true;
+            break;
+        case GameOpJg:
+        case GameOpJl:
+            if (words.size() != 3)
+                return badInsn(GameErrorBadInsnFormat);
+        
+            try {
+                insn.count = stoi(words[1], nullptr, 0);
+                insn.addr  = stoul(words[2], nullptr, 0);
+            } catch (...) {
+                return badInsn(GameErrorBadInsnFormat);
+            }
+            break;
+        case GameOpJ:
+        case GameOpJe:
+            if (words.size() != 2)
+                return badInsn(GameErrorBadInsnFormat);
+        
+            try {
+                insn.addr = stol(words[1], nullptr, 0);
+            } catch (...) {
+                return badInsn(GameErrorBadInsnFormat);
+            }
+            break;
+        case GameOpBad:
+            return badInsn(GameErrorBadInsn);
+    }
+    
+    return insn;
+}
+
+void GameProgram::load(const string &path) {
+    std::ifstream code(path);
+    if (code.fail())
+        throw GameException(GameErrorReadFailed, path);
+    
+    parse(code);
+    
+    if (code.bad())
+        throw GameException(GameErrorReadFailed, path);
+}
+
+void GameProgram::parse(std::istream &code) {
+    string line;
+    while (std::getline(code, line)) {
+        vector<string> words;
+        size_t i = 0;
+        while (true) {
+            string s;
+            size_t spc = line.find(' ', i);
+            if (spc == s.npos)
+                s = string(line, i);
+            else
+                s = string(line, i, spc - i);
+            
+            if (s.length())
+                words.push_back(s);
+            
+            if (spc == s.npos)
+                break;
+            
+            i = spc + 1;
+        }
+        
+        if (words.size())
+            insn.push_back(decode(words));
+    }
+    
+    fuse();
+}
+
+void GameProgram::fuse() {
+    fused.assign(insn.size(), GameFusion());
+    
+    for (size_t pc = 0; pc < insn.size(); pc++) {
+        GameFusion &run = fused[pc];
+        
+        size_t next   = pc;
+        int    rotate = 0;
+        bool   fusable = true;
+        while (fusable && run.length < GameInsnBudget && next < insn.size()) {
+            const GameInsn &step = insn[next];
+            
+            switch (step.op) {
+                case GameOpJ:
+                    next = step.addr;
+                    break;
+                case GameOpBack:
+                    rotate += 2;
+                    next++;
+                    break;
+                case GameOpLeft:
+                    rotate += 3 * step.count;
+                    run.repCnt = (int8_t)(step.count - 1);
+                    next++;
+                    break;
+                case GameOpRight:
+                    rotate += 1;
+                    run.repCnt = (int8_t)(step.count - 1);
+                    next++;
+                    break;
+                case GameOpTurn:
+                    rotate = 0;
+                    run.turns++;
+                    next++;
+                    break;
+                default:
+                    fusable = false;
+                    continue;
+            }
+            
+            run.length++;
+        }
+        
+        run.rotate = (uint8_t)(rotate % 4);
+        run.next   = next;
+        
+        if (!fusable && insn[next].op != GameOpBad)
+            run.ends = insn[next].op;
+    }
+}
+
+void GameProgram::write(std::ostream &code) const {
+    for (const GameInsn &insn : this->insn) {
+        code << GameOpString(insn.op);
+        
+        switch (insn.op) {
+            case GameOpEat:
+            case GameOpGo:
+            case GameOpStr:
+            case GameOpLeft:
+            case GameOpRight:
+                if (insn.random)
+                    code << " r";
+                else if (insn.count != 1)
+                    code << " " << insn.count;
+                break;
+            case GameOpTurn:
+                code << " r";
+                break;
+            case GameOpJg:
+            case GameOpJl:
+                code << " " << insn.count << " " << insn.addr;
+                break;
+            case GameOpJ:
+            case GameOpJe:
+                code << " " << insn.addr;
+                break;
+            default:
+                break;
+        }
+        
+        code << "\n";
+    }
+}
+
+uint64_t GameProgramHash(const string &code) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : code) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    
+    return hash;
+}
+
+GameProgramRef GameProgramCache::load(const string &path) {
+    struct stat info;
+    bool known = stat(path.c_str(), &info) == 0;
+    
+    if (known) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto entry = paths.find(path);
+        if (entry != paths.end() && entry->second.mtime == (int64_t)info.st_mtime &&
+            entry->second.size == (int64_t)info.st_size)
+            return entry->second.program;
+    }
+    
+    std::ifstream file(path);
+    if (file.fail())
+        throw GameException(GameErrorReadFailed, path);
+    
+    string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (file.bad())
+        throw GameException(GameErrorReadFailed, path);
+    
+    GameProgramRef program = parse(code);
+    
+    if (known) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        Entry &entry = paths[path];
+        entry.mtime   = (int64_t)info.st_mtime;
+        entry.size    = (int64_t)info.st_size;
+        entry.program = program;
+    }
+    
+    return program;
+}
+
+GameProgramRef GameProgramCache::find(uint64_t hash, const string &code) {
+    auto range = images.equal_range(hash);
+    for (auto image = range.first; image != range.second; ++image)
+        if (image->second.code == code)
+            return image->second.program;
+    
+    return nullptr;
+}
+
+GameProgramRef GameProgramCache::parse(const string &code) {
+    uint64_t hash = GameProgramHash(code);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        GameProgramRef program = find(hash, code);
+        if (program)
+            return program;
+    }
+    
+    std::istringstream stream(code);
+    std::unique_ptr<GameProgram> program(new GameProgram);
+    program->parse(stream);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    GameProgramRef parsed = find(hash, code);
+    if (parsed)
+        return parsed;
+    
+    Image image;
+    image.code    = code;
+    image.program = GameProgramRef(program.release());
+    images.insert(std::make_pair(hash, image));
+    
+    return image.program;
+}
+
+size_t GameProgramCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return images.size();
+}
+
+void GameProgramCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    paths.clear();
+    images.clear();
+}
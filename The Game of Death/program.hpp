@@ -0,0 +1,110 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <mutex>
+#include <unordered_map>
+#include "game.hpp"
+
+
+typedef enum {
+    GameOpEat,
+    GameOpGo,
+    GameOpClon,
+    GameOpStr,
+    GameOpLeft,
+    GameOpRight,
+    GameOpBack,
+    GameOpTurn,
+    GameOpJg,
+    GameOpJl,
+    GameOpJ,
+    GameOpJe,
+    GameOpBad
+} GameOp;
+static const GameOp GameOpMax = GameOpJe;
+
+static inline bool GameOpIsAction(GameOp op) {
+    return op <= GameOpStr;
+}
+
+const char *GameOpString(GameOp op);
+
+typedef struct GameInsn {
+    GameOp      op     = GameOpBad;
+    bool        random = false;
+    int         count  = 1;
+    std::size_t addr   = 0;
+    GameError   error  = GameErrorBadInsn;
+} GameInsn;
+
+static const int GameInsnBudget = 30;
+
+// The combined effect of the run of j, back, left, right and turn
+// instructions starting at a pc, which needs no board or weight to
+// resolve: turns random directions drawn, quarter turns right after the
+// last draw, the repeat count left behind (-1 if untouched) and the pc of
+// the instruction that ends the run. When that is an action or a
+// conditional jump, ends holds its op and the whole run including it is
+// executed by one handler; otherwise ends is GameOpBad and the run is
+// executed one instruction at a time.
+typedef struct GameFusion {
+    uint8_t     length = 0;
+    uint8_t     turns  = 0;
+    uint8_t     rotate = 0;
+    int8_t      repCnt = -1;
+    GameOp      ends   = GameOpBad;
+    std::size_t next   = 0;
+} GameFusion;
+
+typedef struct GameProgram {
+    std::vector<GameInsn>   insn;
+    std::vector<GameFusion> fused;
+    
+    void load(const std::string &path);
+    void parse(std::istream &code);
+    void write(std::ostream &code) const;
+    void fuse();
+    
+    static GameInsn decode(const std::vector<std::string> &words);
+} GameProgram;
+
+uint64_t GameProgramHash(const std::string &code);
+
+// Shares decoded programs between races. Images are keyed by a hash of the
+// source and keep the source once to rule out collisions; a path whose
+// size and modification time are unchanged is served without reading it.
+class GameProgramCache {
+private:
+    typedef struct Image {
+        std::string    code;
+        GameProgramRef program;
+    } Image;
+    
+    typedef struct Entry {
+        int64_t        mtime = 0;
+        int64_t        size  = -1;
+        GameProgramRef program;
+    } Entry;
+    
+    std::mutex mutex;
+    
+    std::unordered_map<std::string, Entry>   paths;
+    std::unordered_multimap<uint64_t, Image> images;
+    
+    GameProgramRef find(uint64_t hash, const std::string &code);
+public:
+    GameProgramRef load(const std::string &path);
+    GameProgramRef parse(const std::string &code);
+    
+    std::size_t size();
+    void        clear();
+};
+
+
+#endif
@@ -0,0 +1,113 @@
+#include "recorder.hpp"
+#include <ctime>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+UIRecorder::UIRecorder(std::FILE *file, UIRecordFormat format, int width, int height) {
+    this->file   = file;
+    this->format = format;
+    
+    if (format == UIRecordCast) {
+        string header = "{\"version\": 2, \"width\": " + to_string(width) +
+                        ", \"height\": " + to_string(height) +
+                        ", \"timestamp\": " + to_string((long long)std::time(nullptr)) + "}\n";
+        std::fwrite(header.data(), 1, header.size(), file);
+    }
+    
+    start  = std::chrono::steady_clock::now();
+    thread = std::thread(&UIRecorder::writeLoop, this);
+}
+
+UIRecorder::~UIRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    
+    ready.notify_one();
+    thread.join();
+    
+    std::fflush(file);
+}
+
+bool UIRecorder::record(string &data) {
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        if (stopping || queued + data.size() > UIRecorderBacklog)
+            return false;
+        
+        if (!frames.empty() && frames.back().time == time.count())
+            frames.back().data += data;
+        else {
+            frames.push_back(Frame());
+            frames.back().time = time.count();
+            frames.back().data.swap(data);
+        }
+        
+        queued += frames.back().data.size();
+    }
+    
+    data.clear();
+    ready.notify_one();
+    return true;
+}
+
+void UIRecorder::writeFrame(const Frame &frame, string &buffer) {
+    if (format == UIRecordANSI) {
+        buffer += frame.data;
+        return;
+    }
+    
+    char time[32];
+    std::snprintf(time, sizeof(time), "[%.6f, \"o\", \"", frame.time);
+    buffer += time;
+    
+    for (unsigned char ch : frame.data) {
+        if (ch == '"' || ch == '\\') {
+            buffer += '\\';
+            buffer += ch;
+        } else if (ch < 0x20 || ch >= 0x7f) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", ch);
+            buffer += escape;
+        } else
+            buffer += ch;
+    }
+    
+    buffer += "\"]\n";
+}
+
+void UIRecorder::writeLoop() {
+    std::deque<Frame> batch;
+    string            buffer;
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [this]() {
+            return !frames.empty() || stopping;
+        });
+        
+        if (frames.empty())
+            break;
+        
+        batch.swap(frames);
+        queued = 0;
+        lock.unlock();
+        
+        for (Frame &frame : batch)
+            writeFrame(frame, buffer);
+        batch.clear();
+        
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        std::fflush(file);
+        buffer.clear();
+        
+        lock.lock();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+
+#include <cstdio>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+
+static const std::size_t UIRecorderBacklog = 1 << 22;
+
+typedef enum {
+    UIRecordANSI,
+    UIRecordCast
+} UIRecordFormat;
+
+// Takes ANSI-encoded screen updates from the display at flush time and
+// writes them from a background thread, either as a raw ANSI stream or as
+// an asciicast v2 file with timestamps relative to the first frame.
+class UIRecorder {
+private:
+    typedef struct Frame {
+        double      time;
+        std::string data;
+    } Frame;
+    
+    std::FILE     *file;
+    UIRecordFormat format;
+    
+    std::chrono::steady_clock::time_point start;
+    
+    std::mutex              mutex;
+    std::condition_variable ready;
+    std::deque<Frame>       frames;
+    std::size_t             queued   = 0;
+    bool                    stopping = false;
+    
+    std::thread thread;
+    void        writeLoop();
+    void        writeFrame(const Frame &frame, std::string &buffer);
+public:
+    UIRecorder(std::FILE *file, UIRecordFormat format, int width, int height);
+    ~UIRecorder();
+    
+    bool record(std::string &data);
+};
+
+
+#endif
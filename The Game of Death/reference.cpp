@@ -0,0 +1,452 @@
+#include "reference.hpp"
+#include <sstream>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+using std::stoi;
+using std::stol;
+using std::stoul;
+
+
+typedef struct GameStateHasher {
+    uint64_t value = 0xcbf29ce484222325ULL;
+    
+    void add(int64_t field) {
+        for (int i = 0; i < 8; i++) {
+            value ^= (uint8_t)(field >> (i * 8));
+            value *= 0x100000001b3ULL;
+        }
+    }
+} GameStateHasher;
+
+template <typename C>
+static void hashCell(GameStateHasher &hasher, const C &cell) {
+    hasher.add(cell.x);
+    hasher.add(cell.y);
+    hasher.add(cell.weight);
+    hasher.add(cell.direction);
+    hasher.add((int64_t)cell.pc);
+    hasher.add(cell.rep);
+    hasher.add(cell.repCnt);
+}
+
+template <typename R>
+static void hashRace(GameStateHasher &hasher, const R &race) {
+    hasher.add(race.extinct);
+    hasher.add(race.extinctionDate);
+    hasher.add(race.disqualified);
+    hasher.add(race.clones);
+    hasher.add(race.kills);
+    hasher.add(race.wasted);
+    hasher.add((int64_t)race.cells.size());
+    
+    for (auto &cell : race.cells)
+        hashCell(hasher, cell);
+}
+
+uint64_t GameStateHash(Game &game) {
+    game.settle();
+    
+    GameStateHasher hasher;
+    hasher.add(game.currentMove());
+    hasher.add((int64_t)game.getRandom().state);
+    
+    for (size_t i = 0; i < game.raceCount(); i++)
+        hashRace(hasher, game.raceWithIndex(i));
+    
+    return hasher.value;
+}
+
+
+static void movePosInDirection(int &x, int &y, Direction dir) {
+    if (dir == DirectionNorth)
+        y--;
+    else if (dir == DirectionEast)
+        x++;
+    else if (dir == DirectionSouth)
+        y++;
+    else
+        x--;
+}
+
+GameReference::GameReference(Game &game, const std::vector<string> &sources) {
+    if (game.currentMove() != 0 || sources.size() != game.raceCount())
+        throw GameException(GameErrorInternal, "reference needs a fresh game and one program per race");
+    
+    config = game.getConfig();
+    rng    = game.getRandom();
+    
+    for (size_t i = 0; i < game.raceCount(); i++) {
+        Race &race = game.raceWithIndex(i);
+        
+        GameRefRace ref;
+        ref.id = race.id;
+        
+        for (Cell &cell : race.cells) {
+            GameRefCell refCell;
+            refCell.x         = cell.x;
+            refCell.y         = cell.y;
+            refCell.weight    = cell.weight;
+            refCell.direction = cell.direction;
+            ref.cells.push_back(refCell);
+        }
+        
+        std::istringstream code(sources[i]);
+        string line;
+        while (std::getline(code, line)) {
+            GameRefWords words;
+            
+            std::istringstream split(line);
+            string word;
+            while (std::getline(split, word, ' '))
+                if (word.length())
+                    words.push_back(word);
+            
+            if (words.size())
+                ref.code.push_back(words);
+        }
+        
+        races.push_back(ref);
+    }
+}
+
+GameRefCell *GameReference::cellAt(int x, int y, RaceID *race) {
+    for (GameRefRace &r : races)
+        for (GameRefCell &cell : r.cells)
+            if (cell.x == x && cell.y == y && cell.weight > 0) {
+                if (race)
+                    *race = r.id;
+                return &cell;
+            }
+    
+    return nullptr;
+}
+
+bool GameReference::isVisitable(int x, int y) {
+    return x >= 0 && x < config.width && y >= 0 && y < config.height && !cellAt(x, y);
+}
+
+GameRefCell *GameReference::nearEnemy(GameRefCell &cell, GameRefRace &race) {
+    for (int i = 0; i < 4; i++) {
+        Direction scanDir = (Direction)((cell.direction + i) % 4);
+        
+        int scanX = cell.x;
+        int scanY = cell.y;
+        movePosInDirection(scanX, scanY, scanDir);
+        movePosInDirection(scanX, scanY, (Direction)((scanDir + 3) % 4));
+        
+        for (int j = 0; j < 3; j++) {
+            RaceID id;
+            GameRefCell *enemy = cellAt(scanX, scanY, &id);
+            if (enemy && id != race.id)
+                return enemy;
+            
+            movePosInDirection(scanX, scanY, (Direction)((scanDir + 1) % 4));
+        }
+    }
+    
+    return nullptr;
+}
+
+void GameReference::eat(GameRefCell &cell) {
+    cell.weight++;
+}
+
+void GameReference::go(GameRefCell &cell) {
+    if (--cell.weight <= 0)
+        return;
+    
+    int x = cell.x;
+    int y = cell.y;
+    movePosInDirection(x, y, cell.direction);
+    
+    if (isVisitable(x, y)) {
+        cell.x = x;
+        cell.y = y;
+    }
+}
+
+void GameReference::clon(size_t index, GameRefRace &race) {
+    GameRefCell &cell = race.cells[index];
+    if ((cell.weight -= 10) <= 0)
+        return;
+    
+    int x = cell.x;
+    int y = cell.y;
+    movePosInDirection(x, y, cell.direction);
+    
+    if (x < 0 || x >= config.width || y < 0 || y >= config.height)
+        return;
+    
+    GameRefCell *heal = cellAt(x, y);
+    if (heal) {
+        heal->weight += 2;
+        return;
+    }
+    
+    GameRefCell clone;
+    clone.x = x;
+    clone.y = y;
+    clone.direction = (Direction)rng.below(4);
+    
+    race.cells.push_back(clone);
+    race.clones++;
+}
+
+void GameReference::str(GameRefCell &cell, GameRefRace &race) {
+    if (--cell.weight <= 0)
+        return;
+    
+    GameRefCell *enemy = nearEnemy(cell, race);
+    if (!enemy)
+        return;
+    
+    enemy->weight -= rng.below(3 + (uint32_t)cell.weight / 2);
+    if (enemy->weight <= 0)
+        race.kills++;
+}
+
+const GameRefWords &GameReference::fetchInsn(GameRefRace &race, size_t &pc) {
+    if (pc >= race.code.size())
+        throw GameException(GameErrorSegFault);
+    
+    return race.code[pc++];
+}
+
+void GameReference::execute(GameRefRace &race, size_t index) {
+    GameRefCell &cell = race.cells[index];
+    insnPC = cell.pc;
+    
+    if (cell.repCnt) {
+        for (int i = 0; i < cell.repCnt; i++) {
+            if (cell.rep == CellInsnRepEat)
+                eat(cell);
+            else if (cell.rep == CellInsnRepGo)
+                go(cell);
+            else
+                str(cell, race);
+        }
+        
+        cell.repCnt--;
+        return;
+    }
+    
+    for (int i = 0; i < 30; i++) {
+        insnPC = cell.pc;
+        const GameRefWords &insn = fetchInsn(race, cell.pc);
+        const string &op = insn[0];
+        
+        if (op == "eat" || op == "go" || op == "str" || op == "left" || op == "right") {
+            int count = 1;
+            
+            if (insn.size() == 2 && insn[1] == "r") {
+                if (op != "eat" && op != "go")
+                    throw GameException(GameErrorBadInsnFormat);
+                
+                count = rng.below(6);
+            } else if (insn.size() == 2) {
+                try {
+                    count = stoi(insn[1], nullptr, 0);
+                } catch (...) {
+                    count = -1;
+                }
+                
+                if (count < 2 || count > 99)
+                    throw GameException(GameErrorBadInsnFormat);
+            } else if (insn.size() > 2)
+                throw GameException(GameErrorBadInsnFormat);
+            
+            cell.repCnt = count;
+            
+            if (cell.repCnt) {
+                if (op == "eat") {
+                    cell.rep = CellInsnRepEat;
+                    eat(cell);
+                } else if (op == "go") {
+                    cell.rep = CellInsnRepGo;
+                    go(cell);
+                } else if (op == "str") {
+                    cell.rep = CellInsnRepStr;
+                    str(cell, race);
+                } else if (op == "left")
+                    cell.direction = (Direction)((cell.direction + 3 * cell.repCnt) % 4);
+                else
+                    cell.direction = (Direction)((cell.direction + 1) % 4);
+                
+                cell.repCnt--;
+            }
+            
+            if (op != "left" && op != "right")
+                return;
+        } else if (op == "clon") {
+            clon(index, race);
+            return;
+        } else if (op == "back")
+            cell.direction = (Direction)((cell.direction + 2) % 4);
+        else if (op == "turn") {
+            if (insn.size() != 2 || insn[1] != "r")
+                throw GameException(GameErrorBadInsnFormat);
+            
+            cell.direction = (Direction)rng.below(4);
+        } else if (op == "jg" || op == "jl") {
+            if (insn.size() != 3)
+                throw GameException(GameErrorBadInsnFormat);
+            
+            int    m;
+            size_t addr;
+            try {
+                m    = stoi(insn[1], nullptr, 0);
+                addr = stoul(insn[2], nullptr, 0);
+            } catch (...) {
+                throw GameException(GameErrorBadInsnFormat);
+            }
+            
+            if (op == "jg" ? cell.weight > m : cell.weight < m)
+                cell.pc = addr;
+        } else if (op == "j" || op == "je") {
+            if (insn.size() != 2)
+                throw GameException(GameErrorBadInsnFormat);
+            
+            size_t addr;
+            try {
+                addr = stol(insn[1], nullptr, 0);
+            } catch (...) {
+                throw GameException(GameErrorBadInsnFormat);
+            }
+            
+            if (op == "j" || nearEnemy(cell, race))
+                cell.pc = addr;
+        } else
+            throw GameException(GameErrorBadInsn);
+    }
+    
+    cell.weight -= 5;
+    race.wasted++;
+}
+
+void GameReference::raceStep() {
+    if (nextRaceIndex >= races.size())
+        nextRaceIndex = 0;
+    
+    GameRefRace &race = races[nextRaceIndex++];
+    if (race.extinct)
+        return;
+    
+    size_t index = 0;
+    for (size_t i = 0;; i++) {
+        if (i >= race.cells.size()) {
+            race.extinct = true;
+            return;
+        }
+        
+        if (race.nextCellIndex >= race.cells.size())
+            race.nextCellIndex = 0;
+        
+        index = race.nextCellIndex++;
+        if (race.cells[index].weight > 0)
+            break;
+    }
+    
+    try {
+        execute(race, index);
+    } catch (GameException &exc) {
+        exc.race = race.id;
+        exc.pc   = insnPC;
+        exc.move = move + 1;
+        
+        if (!GameExceptionIsFault(exc))
+            throw;
+        
+        race.disqualified = true;
+        race.extinct      = true;
+        
+        for (GameRefCell &cell : race.cells)
+            if (cell.weight > 0)
+                cell.weight = 0;
+    }
+}
+
+size_t GameReference::step(size_t n) {
+    size_t i = 0;
+    for (; i < n && !over; i++) {
+        for (size_t j = 0; j < races.size(); j++)
+            raceStep();
+        
+        move++;
+        
+        size_t alive = 0;
+        for (GameRefRace &race : races) {
+            if (!race.extinct)
+                alive++;
+            else if (race.extinctionDate == RaceExtinctionDateNone)
+                race.extinctionDate = move;
+        }
+        
+        over = !alive || move >= config.moveNumber ||
+               (config.stopAtLastSurvivor && alive == 1 && races.size() > 1);
+    }
+    
+    return i;
+}
+
+uint64_t GameReference::hash() {
+    GameStateHasher hasher;
+    hasher.add(move);
+    hasher.add((int64_t)rng.state);
+    
+    for (GameRefRace &race : races)
+        hashRace(hasher, race);
+    
+    return hasher.value;
+}
+
+template <typename T>
+static bool differs(string &report, const char *field, T engine, T reference) {
+    if (engine == reference)
+        return false;
+    
+    report += string(field) + " is " + to_string(engine) + ", reference has " + to_string(reference);
+    return true;
+}
+
+string GameReference::diff(Game &game) {
+    game.settle();
+    
+    string report = "move " + to_string(move) + ": ";
+    
+    if (differs(report, "move", game.currentMove(), move) ||
+        differs(report, "random state", game.getRandom().state, rng.state))
+        return report;
+    
+    for (GameRefRace &ref : races) {
+        Race &race = game.raceWithIndex(ref.id);
+        report = "move " + to_string(move) + ": race " + to_string(ref.id) + " (" + race.name + ") ";
+        
+        if (differs(report, "extinct", race.extinct, ref.extinct) ||
+            differs(report, "extinction date", race.extinctionDate, ref.extinctionDate) ||
+            differs(report, "disqualified", race.disqualified, ref.disqualified) ||
+            differs(report, "clones", race.clones, ref.clones) ||
+            differs(report, "kills", race.kills, ref.kills) ||
+            differs(report, "wasted", race.wasted, ref.wasted) ||
+            differs(report, "cell count", race.cells.size(), ref.cells.size()))
+            return report;
+        
+        for (size_t i = 0; i < ref.cells.size(); i++) {
+            Cell        &cell    = race.cells[i];
+            GameRefCell &refCell = ref.cells[i];
+            report = "move " + to_string(move) + ": race " + to_string(ref.id) + " (" + race.name + ") cell " + to_string(i) + " ";
+            
+            if (differs(report, "x", cell.x, refCell.x) ||
+                differs(report, "y", cell.y, refCell.y) ||
+                differs(report, "weight", cell.weight, refCell.weight) ||
+                differs(report, "direction", (int)cell.direction, (int)refCell.direction) ||
+                differs(report, "pc", cell.pc, refCell.pc) ||
+                differs(report, "rep", (int)cell.rep, (int)refCell.rep) ||
+                differs(report, "repeat count", cell.repCnt, refCell.repCnt))
+                return report;
+        }
+    }
+    
+    return string();
+}
@@ -0,0 +1,84 @@
+#ifndef REFERENCE_HPP
+#define REFERENCE_HPP
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "game.hpp"
+
+
+typedef std::vector<std::string> GameRefWords;
+
+typedef struct GameRefCell {
+    CellInsnRep rep    = CellInsnRepEat;
+    int         repCnt = 0;
+    
+    int  x;
+    int  y;
+    long weight = 5;
+    
+    Direction   direction = DirectionNorth;
+    std::size_t pc        = 0;
+} GameRefCell;
+
+typedef struct GameRefRace {
+    RaceID id;
+    
+    bool extinct        = false;
+    int  extinctionDate = RaceExtinctionDateNone;
+    bool disqualified   = false;
+    
+    long clones = 0;
+    long kills  = 0;
+    long wasted = 0;
+    
+    std::vector<GameRefWords> code;
+    std::vector<GameRefCell>  cells;
+    std::size_t               nextCellIndex = 0;
+} GameRefRace;
+
+// The reference interpreter is the behavioural spec that faster engines are
+// checked against. It is kept deliberately plain: programs stay as words and
+// are decoded on every fetch, and every board query scans all cells.
+class GameReference {
+private:
+    GameConfig config;
+    GameRandom rng;
+    
+    std::vector<GameRefRace> races;
+    std::size_t nextRaceIndex = 0;
+    
+    int  move = 0;
+    bool over = false;
+    
+    std::size_t insnPC = 0;
+    
+    GameRefCell *cellAt(int x, int y, RaceID *race = nullptr);
+    GameRefCell *nearEnemy(GameRefCell &cell, GameRefRace &race);
+    bool         isVisitable(int x, int y);
+    
+    void eat(GameRefCell &cell);
+    void go(GameRefCell &cell);
+    void clon(std::size_t index, GameRefRace &race);
+    void str(GameRefCell &cell, GameRefRace &race);
+    
+    const GameRefWords &fetchInsn(GameRefRace &race, std::size_t &pc);
+    void                execute(GameRefRace &race, std::size_t index);
+    void                raceStep();
+public:
+    GameReference(Game &game, const std::vector<std::string> &sources);
+    
+    int  currentMove() {return move;}
+    bool isOver()      {return over;}
+    
+    std::size_t step(std::size_t n = 1);
+    
+    uint64_t    hash();
+    std::string diff(Game &game);
+};
+
+uint64_t GameStateHash(Game &game);
+
+
+#endif
@@ -0,0 +1,395 @@
+#include "spectator.hpp"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+template <typename T>
+static void put(string &frame, T value) {
+    frame.append((const char *)&value, sizeof(value));
+}
+
+static GameException socketError(const string &what) {
+    return GameException(GameErrorSocket, what + ": " + std::strerror(errno));
+}
+
+static bool isUnixAddress(const string &address) {
+    return address.find('/') != string::npos;
+}
+
+static sockaddr_in tcpAddress(const string &address) {
+    size_t colon = address.rfind(':');
+    string host  = colon == string::npos ? "127.0.0.1" : address.substr(0, colon);
+    string port  = colon == string::npos ? address : address.substr(colon + 1);
+    
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)std::atoi(port.c_str()));
+    
+    if (host.empty() || host == "localhost")
+        host = "127.0.0.1";
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        throw GameException(GameErrorSocket, "bad address " + address);
+    
+    return addr;
+}
+
+static sockaddr_un unixAddress(const string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    
+    if (path.length() >= sizeof(addr.sun_path))
+        throw GameException(GameErrorSocket, "path too long " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+    
+    return addr;
+}
+
+int GameSpectatorConnect(const string &address) {
+    int fd;
+    
+    if (isUnixAddress(address)) {
+        sockaddr_un addr = unixAddress(address);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        sockaddr_in addr = tcpAddress(address);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    
+    if (fd < 0)
+        throw socketError("connect " + address);
+    
+    return fd;
+}
+
+
+GameSpectatorServer::GameSpectatorServer(Game &game, const string &address) {
+    width = game.getConfig().width;
+    
+    int one = 1;
+    
+    if (isUnixAddress(address)) {
+        sockaddr_un addr = unixAddress(address);
+        unlink(address.c_str());
+        
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0)
+            throw socketError("bind " + address);
+        unixPath = address;
+    } else {
+        sockaddr_in addr = tcpAddress(address);
+        
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd >= 0)
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0)
+            throw socketError("bind " + address);
+    }
+    
+    if (listen(listenFd, 16) < 0 || pipe(wakeFds) < 0)
+        throw socketError("listen " + address);
+    
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+    fcntl(wakeFds[0], F_SETFL, fcntl(wakeFds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeFds[1], F_SETFL, fcntl(wakeFds[1], F_GETFL) | O_NONBLOCK);
+    
+    lastFrame = std::chrono::steady_clock::now();
+    thread    = std::thread(&GameSpectatorServer::serveLoop, this);
+}
+
+GameSpectatorServer::~GameSpectatorServer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    
+    wake();
+    thread.join();
+    
+    close(listenFd);
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    
+    if (unixPath.length())
+        unlink(unixPath.c_str());
+}
+
+void GameSpectatorServer::change(int x, int y, RaceID race) {
+    changes[(int64_t)y * width + x] = race;
+}
+
+void GameSpectatorServer::cellSpawned(Game &game, Race &race, Cell &cell) {
+    if (clients)
+        change(cell.x, cell.y, race.id);
+}
+
+void GameSpectatorServer::cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) {
+    if (!clients)
+        return;
+    
+    change(fromX, fromY, RaceIDNone);
+    change(cell.x, cell.y, race.id);
+}
+
+void GameSpectatorServer::cellDied(Game &game, Race &race, Cell &cell) {
+    if (clients)
+        change(cell.x, cell.y, RaceIDNone);
+}
+
+void GameSpectatorServer::moveEnded(Game &game) {
+    if (!clients) {
+        changes.clear();
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastFrame < std::chrono::milliseconds(GameSpectatorFrameInterval) && !keyframeWanted)
+        return;
+    
+    lastFrame = now;
+    
+    if (keyframeWanted.exchange(false) || ++framesSinceKey >= GameSpectatorKeyframeInterval)
+        publish(game, GameFrameKey);
+    else
+        publish(game, GameFrameDelta);
+}
+
+void GameSpectatorServer::publish(Game &game, GameFrameType type) {
+    string *frame = new string;
+    Frame   ref(frame);
+    
+    put<uint8_t>(*frame, type);
+    put<uint32_t>(*frame, 0);
+    put<int32_t>(*frame, game.currentMove());
+    
+    if (type == GameFrameKey) {
+        put<int32_t>(*frame, game.getConfig().width);
+        put<int32_t>(*frame, game.getConfig().height);
+        put<uint16_t>(*frame, (uint16_t)game.raceCount());
+        
+        uint32_t squares = 0;
+        for (size_t i = 0; i < game.raceCount(); i++) {
+            Race &race = game.raceWithIndex(i);
+            string name = race.name.substr(0, UINT8_MAX);
+            
+            put<uint8_t>(*frame, (uint8_t)name.length());
+            frame->append(name);
+            
+            for (Cell &cell : race.cells)
+                squares += cell.weight > 0;
+        }
+        
+        put<uint32_t>(*frame, squares);
+        for (size_t i = 0; i < game.raceCount(); i++) {
+            Race &race = game.raceWithIndex(i);
+            for (Cell &cell : race.cells)
+                if (cell.weight > 0) {
+                    put<int32_t>(*frame, cell.x);
+                    put<int32_t>(*frame, cell.y);
+                    put<uint16_t>(*frame, race.id);
+                }
+        }
+        
+        framesSinceKey = 0;
+    } else if (type == GameFrameDelta) {
+        put<uint32_t>(*frame, (uint32_t)changes.size());
+        for (auto &square : changes) {
+            put<int32_t>(*frame, (int32_t)(square.first % width));
+            put<int32_t>(*frame, (int32_t)(square.first / width));
+            put<uint16_t>(*frame, square.second);
+        }
+    }
+    
+    changes.clear();
+    
+    uint32_t length = (uint32_t)(frame->size() - 5);
+    std::memcpy(&(*frame)[1], &length, sizeof(length));
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        published.push_back(ref);
+    }
+    
+    wake();
+}
+
+void GameSpectatorServer::finish(Game &game) {
+    if (finished)
+        return;
+    
+    if (clients) {
+        publish(game, GameFrameDelta);
+        publish(game, GameFrameEnd);
+    }
+    
+    finished = true;
+}
+
+void GameSpectatorServer::wake() {
+    char byte = 0;
+    if (write(wakeFds[1], &byte, 1) < 0 && errno != EAGAIN)
+        return;
+}
+
+void GameSpectatorServer::accept(std::vector<Client> &list) {
+    while (true) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        Client client;
+        client.fd = fd;
+        list.push_back(client);
+        
+        clients++;
+        keyframeWanted = true;
+    }
+}
+
+void GameSpectatorServer::deliver(std::vector<Client> &list, const Frame &frame) {
+    bool key = (*frame)[0] != GameFrameDelta;
+    
+    for (Client &client : list) {
+        if (!key && client.stale)
+            continue;
+        
+        if ((*frame)[0] == GameFrameKey || client.queued + frame->size() > GameSpectatorBacklog) {
+            while (client.frames.size() > (client.offset ? 1 : 0)) {
+                client.queued -= client.frames.back()->size();
+                client.frames.pop_back();
+            }
+            
+            client.stale = (*frame)[0] != GameFrameKey;
+            if (client.stale) {
+                keyframeWanted = true;
+                continue;
+            }
+        }
+        
+        client.frames.push_back(frame);
+        client.queued += frame->size();
+    }
+}
+
+bool GameSpectatorServer::send(Client &client) {
+    while (!client.frames.empty()) {
+        const string &frame = *client.frames.front();
+        
+        ssize_t sent = ::send(client.fd, frame.data() + client.offset,
+                              frame.size() - client.offset, MSG_NOSIGNAL);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        
+        client.offset += sent;
+        if (client.offset < frame.size())
+            return true;
+        
+        client.queued -= frame.size();
+        client.offset  = 0;
+        client.frames.pop_front();
+    }
+    
+    return true;
+}
+
+void GameSpectatorServer::serveLoop() {
+    std::vector<Client> list;
+    std::vector<Frame>  incoming;
+    std::vector<pollfd> fds;
+    
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    
+    while (true) {
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            incoming.swap(published);
+            stop = stopping;
+        }
+        
+        for (Frame &frame : incoming)
+            deliver(list, frame);
+        incoming.clear();
+        
+        if (stop) {
+            bool pending = false;
+            for (Client &client : list)
+                pending |= !client.frames.empty();
+            
+            if (deadline == std::chrono::steady_clock::time_point::max())
+                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(GameSpectatorLinger);
+            if (!pending || std::chrono::steady_clock::now() >= deadline)
+                break;
+        }
+        
+        fds.clear();
+        fds.push_back({wakeFds[0], POLLIN, 0});
+        fds.push_back({listenFd, (short)(stop ? 0 : POLLIN), 0});
+        for (Client &client : list)
+            fds.push_back({client.fd, (short)(client.frames.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+        
+        if (poll(fds.data(), fds.size(), stop ? 50 : -1) < 0 && errno != EINTR)
+            break;
+        
+        if (fds[0].revents & POLLIN) {
+            char buffer[64];
+            while (read(wakeFds[0], buffer, sizeof(buffer)) > 0);
+        }
+        
+        for (size_t i = 2, c = 0; i < fds.size(); i++) {
+            short events = fds[i].revents;
+            bool  alive  = true;
+            
+            if (events & POLLIN) {
+                char buffer[256];
+                alive = recv(list[c].fd, buffer, sizeof(buffer), 0) > 0;
+            }
+            if (alive && (events & (POLLERR | POLLHUP)))
+                alive = false;
+            if (alive && (events & POLLOUT))
+                alive = send(list[c]);
+            
+            if (alive) {
+                c++;
+                continue;
+            }
+            
+            close(list[c].fd);
+            list.erase(list.begin() + c);
+            clients--;
+        }
+        
+        if (fds[1].revents & POLLIN)
+            accept(list);
+    }
+    
+    for (Client &client : list)
+        close(client.fd);
+    clients = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef SPECTATOR_HPP
+#define SPECTATOR_HPP
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "game.hpp"
+
+
+static const int         GameSpectatorFrameInterval    = 33;
+static const int         GameSpectatorKeyframeInterval = 150;
+static const std::size_t GameSpectatorBacklog          = 1 << 20;
+static const int         GameSpectatorLinger           = 1000;
+
+typedef enum {
+    GameFrameKey   = 'K',
+    GameFrameDelta = 'D',
+    GameFrameEnd   = 'E'
+} GameFrameType;
+
+// Frames are a uint8 type and a uint32 payload length, host byte order.
+// Keyframe: int32 move, width, height, uint16 race count, each race name as
+// uint8 length + bytes, uint32 square count and the occupied squares.
+// Delta: int32 move, uint32 square count and the squares changed since the
+// previous frame. A square is int32 x, y and uint16 race, RaceIDNone if empty.
+class GameSpectatorServer : public GameObserver {
+private:
+    typedef std::shared_ptr<const std::string> Frame;
+    
+    typedef struct Client {
+        int               fd;
+        std::deque<Frame> frames;
+        std::size_t       offset = 0;
+        std::size_t       queued = 0;
+        bool              stale  = true;
+    } Client;
+    
+    int         width;
+    std::string unixPath;
+    int         listenFd   = -1;
+    int         wakeFds[2] = {-1, -1};
+    
+    std::atomic<int>  clients{0};
+    std::atomic<bool> keyframeWanted{false};
+    
+    std::unordered_map<int64_t, RaceID>   changes;
+    std::chrono::steady_clock::time_point lastFrame;
+    int                                   framesSinceKey = 0;
+    
+    std::mutex         mutex;
+    std::vector<Frame> published;
+    bool               stopping = false;
+    
+    bool finished = false;
+    
+    std::thread thread;
+    void        serveLoop();
+    void        accept(std::vector<Client> &list);
+    void        deliver(std::vector<Client> &list, const Frame &frame);
+    bool        send(Client &client);
+    void        wake();
+    
+    void change(int x, int y, RaceID race);
+    void publish(Game &game, GameFrameType type);
+public:
+    GameSpectatorServer(Game &game, const std::string &address);
+    ~GameSpectatorServer();
+    
+    void cellSpawned(Game &game, Race &race, Cell &cell) override;
+    void cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) override;
+    void cellDied(Game &game, Race &race, Cell &cell) override;
+    void moveEnded(Game &game) override;
+    
+    void finish(Game &game);
+};
+
+int GameSpectatorConnect(const std::string &address);
+
+
+#endif
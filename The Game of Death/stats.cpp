@@ -0,0 +1,188 @@
+#include "stats.hpp"
+#include <algorithm>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+static const char *const GameStatsMetricNames[GameStatsMetrics] = {
+    "cells",
+    "biomass",
+    "clones",
+    "kills",
+    "wasted"
+};
+
+
+GameStatsRecorder::GameStatsRecorder(Game &game, std::FILE *file, GameStatsFormat format, int interval) {
+    this->file     = file;
+    this->format   = format;
+    this->interval = std::max(1, interval);
+    
+    for (size_t i = 0; i < game.raceCount(); i++) {
+        string name = game.raceWithIndex(i).name;
+        if (std::find(names.begin(), names.end(), name) != names.end())
+            name += "." + to_string(i);
+        
+        names.push_back(name);
+    }
+    
+    columns = 1 + names.size() * GameStatsMetrics;
+    
+    chunk.resize(columns * GameStatsChunkRows);
+    spare.push_back(Chunk(columns * GameStatsChunkRows));
+    
+    thread = std::thread(&GameStatsRecorder::writeLoop, this);
+    
+    sample(game);
+}
+
+GameStatsRecorder::~GameStatsRecorder() {
+    finish();
+}
+
+void GameStatsRecorder::moveEnded(Game &game) {
+    if (game.currentMove() % interval == 0 || game.isOver())
+        sample(game);
+}
+
+void GameStatsRecorder::sample(Game &game) {
+    if (game.currentMove() == lastMove || finished)
+        return;
+    
+    lastMove = game.currentMove();
+    
+    chunk[rows] = lastMove;
+    for (size_t i = 0; i < names.size(); i++) {
+        RaceStats stats = game.raceWithIndex(i).stats();
+        
+        int64_t *column = &chunk[(1 + i * GameStatsMetrics) * GameStatsChunkRows + rows];
+        column[0 * GameStatsChunkRows] = stats.cells;
+        column[1 * GameStatsChunkRows] = stats.biomass;
+        column[2 * GameStatsChunkRows] = stats.clones;
+        column[3 * GameStatsChunkRows] = stats.kills;
+        column[4 * GameStatsChunkRows] = stats.wasted;
+    }
+    
+    if (++rows == GameStatsChunkRows)
+        submit();
+}
+
+void GameStatsRecorder::submit() {
+    if (!rows)
+        return;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        full.push_back(std::move(chunk));
+        fullRows.push_back(rows);
+        
+        if (spare.size()) {
+            chunk = std::move(spare.back());
+            spare.pop_back();
+        } else
+            chunk = Chunk(columns * GameStatsChunkRows);
+    }
+    
+    ready.notify_one();
+    rows = 0;
+}
+
+void GameStatsRecorder::finish() {
+    if (finished)
+        return;
+    
+    submit();
+    finished = true;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    
+    ready.notify_one();
+    thread.join();
+}
+
+void GameStatsRecorder::writeHeader() {
+    if (format == GameStatsCSV) {
+        string header = "move";
+        for (const string &name : names)
+            for (const char *metric : GameStatsMetricNames)
+                header += "," + name + "_" + metric;
+        
+        header += "\n";
+        std::fwrite(header.data(), 1, header.size(), file);
+        return;
+    }
+    
+    uint32_t count = (uint32_t)names.size();
+    std::fwrite("GODSTAT1", 1, 8, file);
+    std::fwrite(&count, sizeof(count), 1, file);
+    
+    for (const string &name : names) {
+        uint32_t length = (uint32_t)name.length();
+        std::fwrite(&length, sizeof(length), 1, file);
+        std::fwrite(name.data(), 1, length, file);
+    }
+}
+
+void GameStatsRecorder::writeChunk(const Chunk &chunk, int rows) {
+    if (format == GameStatsCSV) {
+        string text;
+        for (int row = 0; row < rows; row++) {
+            for (size_t column = 0; column < columns; column++) {
+                if (column)
+                    text += ',';
+                text += to_string(chunk[column * GameStatsChunkRows + row]);
+            }
+            
+            text += '\n';
+        }
+        
+        std::fwrite(text.data(), 1, text.size(), file);
+        return;
+    }
+    
+    uint32_t count = (uint32_t)rows;
+    std::fwrite(&count, sizeof(count), 1, file);
+    
+    for (size_t column = 0; column < columns; column++)
+        std::fwrite(&chunk[column * GameStatsChunkRows], sizeof(int64_t), rows, file);
+}
+
+void GameStatsRecorder::writeLoop() {
+    writeHeader();
+    
+    std::vector<Chunk> chunks;
+    std::vector<int>   chunkRows;
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [this]() {
+            return full.size() || stopping;
+        });
+        
+        if (full.empty())
+            break;
+        
+        chunks.swap(full);
+        chunkRows.swap(fullRows);
+        lock.unlock();
+        
+        for (size_t i = 0; i < chunks.size(); i++)
+            writeChunk(chunks[i], chunkRows[i]);
+        
+        lock.lock();
+        
+        for (Chunk &chunk : chunks)
+            spare.push_back(std::move(chunk));
+        
+        chunks.clear();
+        chunkRows.clear();
+    }
+    
+    std::fflush(file);
+}
@@ -0,0 +1,70 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "game.hpp"
+
+
+static const int GameStatsDefaultInterval = 100;
+static const int GameStatsChunkRows       = 4096;
+
+typedef enum {
+    GameStatsCSV,
+    GameStatsBinary
+} GameStatsFormat;
+
+static const int GameStatsMetrics = 5;
+
+// Binary layout, host byte order: "GODSTAT1", uint32 race count, each race
+// name as uint32 length + bytes, then chunks of a uint32 row count followed
+// by that many int64 values per column (move, then cells, biomass, clones,
+// kills and wasted for every race).
+class GameStatsRecorder : public GameObserver {
+private:
+    typedef std::vector<int64_t> Chunk;
+    
+    GameStatsFormat          format;
+    int                      interval;
+    std::vector<std::string> names;
+    std::size_t              columns;
+    
+    Chunk chunk;
+    int   rows = 0;
+    int   lastMove = -1;
+    
+    std::FILE *file;
+    
+    std::mutex              mutex;
+    std::condition_variable ready;
+    std::vector<Chunk>      full;
+    std::vector<int>        fullRows;
+    std::vector<Chunk>      spare;
+    bool                    stopping = false;
+    bool                    finished = false;
+    
+    std::thread thread;
+    void        writeLoop();
+    void        writeHeader();
+    void        writeChunk(const Chunk &chunk, int rows);
+    
+    void sample(Game &game);
+    void submit();
+public:
+    GameStatsRecorder(Game &game, std::FILE *file, GameStatsFormat format,
+                      int interval = GameStatsDefaultInterval);
+    ~GameStatsRecorder();
+    
+    void moveEnded(Game &game) override;
+    
+    void finish();
+};
+
+
+#endif
@@ -0,0 +1,294 @@
+#include "view.hpp"
+#include <cstring>
+#include <algorithm>
+
+using std::size_t;
+using std::string;
+using std::to_string;
+
+
+GameView::GameView(UIDisplay *display, const GameConfig &config) {
+    this->display = display;
+    
+    worldWidth  = config.width;
+    worldHeight = config.height;
+    
+    boardWidth  = config.width;
+    boardHeight = config.height;
+    
+    if (!display) {
+        logWriter.reset(new GameWriter(stdout));
+        return;
+    }
+    
+    boardWidth  = std::max(0, std::min(boardWidth,  display->getWidth() - 1));
+    boardHeight = std::max(0, std::min(boardHeight, display->getHeight() - 3));
+    
+    int levels = 0;
+    while (levels < GameViewZoomMax &&
+           (((int64_t)worldWidth - 1) >> levels >= boardWidth ||
+            ((int64_t)worldHeight - 1) >> levels >= boardHeight))
+        levels++;
+    
+    if (levels && boardWidth && boardHeight)
+        density.reset(new GameDensity(worldWidth, worldHeight, levels, UIColorCount));
+    
+    statusY = boardHeight + 1;
+    logTop  = boardHeight + 2;
+    
+    if (display->getHeight() > logTop)
+        logLines.resize(display->getHeight() - logTop);
+    
+    for (int x = 0; x < boardWidth; x++)
+        display->putChar(x, boardHeight, '=');
+    for (int y = 0; y < boardHeight + 1; y++)
+        display->putChar(boardWidth, y, '|');
+    
+    display->setFlushHandler([this]() {
+        renderLog();
+    });
+    display->requestFlush();
+}
+
+GameView::~GameView() {
+    if (display)
+        display->setFlushHandler(nullptr);
+}
+
+bool GameView::isVisible(int x, int y) {
+    return !zoom && x >= originX && x - originX < boardWidth && y >= originY && y - originY < boardHeight;
+}
+
+void GameView::drawCell(Race &race, Cell &cell) {
+    if (isVisible(cell.x, cell.y))
+        display->putChar((int)(cell.x - originX), (int)(cell.y - originY), CellCharacter | UIAttrForColor(UIColorForIndex(race.id)));
+}
+
+void GameView::drawDensity() {
+    int slots = density->getSlots();
+    int steps = (int)sizeof(GameViewDensityRamp) - 1;
+    
+    for (int y = 0; y < boardHeight; y++) {
+        for (int x = 0; x < boardWidth; x++) {
+            int tileX = (int)((originX >> zoom) + x);
+            int tileY = (int)((originY >> zoom) + y);
+            
+            int64_t  total = 0;
+            uint32_t most  = 0;
+            int      slot  = 0;
+            for (int i = 0; i < slots; i++) {
+                uint32_t n = density->at(zoom, tileX, tileY, i);
+                total += n;
+                if (n > most) {
+                    most = n;
+                    slot = i;
+                }
+            }
+            
+            if (!total) {
+                display->putChar(x, y, ' ');
+                continue;
+            }
+            
+            int bits = 0;
+            while (total >>= 1)
+                bits++;
+            
+            int step = std::min(steps - 1, bits * (steps - 1) / (2 * zoom));
+            display->putChar(x, y, (unsigned char)GameViewDensityRamp[step] | UIAttrForColor(UIColorForIndex(slot)));
+        }
+    }
+}
+
+void GameView::scrollTo(Game &game, int zoom, int64_t centerX, int64_t centerY) {
+    int levels = density ? density->getLevels() : 0;
+    this->zoom = std::max(0, std::min(zoom, levels));
+    
+    int64_t columns = (((int64_t)worldWidth  - 1) >> this->zoom) + 1;
+    int64_t rows    = (((int64_t)worldHeight - 1) >> this->zoom) + 1;
+    
+    int64_t tileX = (centerX >> this->zoom) - boardWidth / 2;
+    int64_t tileY = (centerY >> this->zoom) - boardHeight / 2;
+    tileX = std::max<int64_t>(0, std::min(tileX, columns - boardWidth));
+    tileY = std::max<int64_t>(0, std::min(tileY, rows - boardHeight));
+    
+    originX = tileX << this->zoom;
+    originY = tileY << this->zoom;
+    
+    redraw(game);
+}
+
+void GameView::setZoom(Game &game, int zoom) {
+    scrollTo(game, zoom,
+             originX + ((int64_t)boardWidth  << this->zoom) / 2,
+             originY + ((int64_t)boardHeight << this->zoom) / 2);
+}
+
+void GameView::pan(Game &game, int dx, int dy) {
+    scrollTo(game, zoom,
+             originX + ((int64_t)(boardWidth  / 2 + dx) << zoom),
+             originY + ((int64_t)(boardHeight / 2 + dy) << zoom));
+}
+
+string GameView::viewport() {
+    return "1:" + to_string((int64_t)1 << zoom) + " at " + to_string(originX) + "," + to_string(originY);
+}
+
+void GameView::cellSpawned(Game &game, Race &race, Cell &cell) {
+    if (density)
+        density->cellSpawned(game, race, cell);
+    
+    if (display && !suspended)
+        drawCell(race, cell);
+}
+
+void GameView::cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) {
+    if (density)
+        density->cellMoved(game, race, cell, fromX, fromY);
+    
+    if (!display || suspended)
+        return;
+    
+    if (isVisible(fromX, fromY))
+        display->putChar((int)(fromX - originX), (int)(fromY - originY), ' ');
+    drawCell(race, cell);
+}
+
+void GameView::cellDied(Game &game, Race &race, Cell &cell) {
+    if (density)
+        density->cellDied(game, race, cell);
+    
+    if (display && !suspended && isVisible(cell.x, cell.y))
+        display->putChar((int)(cell.x - originX), (int)(cell.y - originY), ' ');
+}
+
+void GameView::raceExtinct(Game &game, Race &race) {
+    log("[ATTENTION] " + race.name + " race extinct!");
+    
+    if (display)
+        UIAttention();
+}
+
+void GameView::raceDisqualified(Game &game, Race &race, const GameFault &fault) {
+    log("[FAULT] " + GameFaultString(game, fault));
+}
+
+void GameView::moveEnded(Game &game) {
+    if (!display || suspended)
+        return;
+    
+    if (zoom) {
+        auto now = std::chrono::steady_clock::now();
+        if (now < nextFrame && !game.isOver())
+            return;
+        
+        drawDensity();
+        nextFrame = now + std::chrono::microseconds(1000000 / UIFrameRate);
+    }
+    
+    display->requestFlush();
+}
+
+void GameView::redraw(Game &game) {
+    if (!display)
+        return;
+    
+    if (zoom)
+        drawDensity();
+    else {
+        for (int y = 0; y < boardHeight; y++) {
+            for (int x = 0; x < boardWidth; x++) {
+                RaceID race;
+                UIChar ch = ' ';
+                if (game.cellAt((int)(originX + x), (int)(originY + y), &race))
+                    ch = CellCharacter | UIAttrForColor(UIColorForIndex(race));
+                
+                display->putChar(x, y, ch);
+            }
+        }
+    }
+    
+    display->requestFlush();
+}
+
+void GameView::setStatus(const string &status) {
+    if (!display || statusY >= display->getHeight() || status == this->status)
+        return;
+    
+    this->status = status;
+    
+    display->eraseLine(statusY);
+    display->putString(0, statusY, status.substr(0, display->getWidth()).c_str());
+}
+
+void GameView::logLine(string &string) {
+    if (logWriter) {
+        string += '\n';
+        logWriter->write(string);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        
+        if (logLines.empty())
+            return;
+        
+        if (logCount < logLines.size())
+            logLines[(logHead + logCount++) % logLines.size()].swap(string);
+        else {
+            logLines[logHead].swap(string);
+            logHead = (logHead + 1) % logLines.size();
+        }
+        
+        logDirty = true;
+    }
+    
+    display->requestFlush();
+}
+
+void GameView::renderLog() {
+    std::lock_guard<std::mutex> lock(logMutex);
+    
+    if (!logDirty)
+        return;
+    
+    int width = display->getWidth();
+    for (size_t row = 0; row < logLines.size(); row++) {
+        const string &line = logLines[(logHead + row) % logLines.size()];
+        size_t length = row < logCount ? line.length() : 0;
+        
+        for (int x = 0; x < width; x++)
+            display->putChar(x, logTop + (int)row, (size_t)x < length ? (unsigned char)line[x] : ' ');
+    }
+    
+    logDirty = false;
+}
+
+void GameView::log(const char *msg) {
+    while (true) {
+        string line;
+        
+        const char *lf = std::strchr(msg, '\n');
+        if (lf)
+            line = string(msg, lf - msg);
+        else
+            line = string(msg);
+        
+        logLine(line);
+        
+        if (!lf)
+            break;
+        
+        msg = lf + 1;
+    }
+}
+
+void GameView::log(const string &string) {
+    log(string.c_str());
+}
+
+void GameView::syncLog() {
+    if (logWriter)
+        logWriter->sync();
+}
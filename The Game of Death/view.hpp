@@ -0,0 +1,99 @@
+#ifndef VIEW_HPP
+#define VIEW_HPP
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include "game.hpp"
+#include "writer.hpp"
+#include "density.hpp"
+
+#if UI_USE_NCURSES
+#include "ncui.hpp"
+#elif UI_USE_ANSI
+#include "ansiui.hpp"
+#else
+#error "No UI backend selected!"
+#endif
+
+
+static const int  GameViewZoomMax       = 30;
+static const char GameViewDensityRamp[] = ".:-=+*#%@";
+
+// Shows the board one square per character, scrolled to the origin. Boards
+// larger than the display also keep a GameDensity pyramid, so the view can
+// zoom out to one character per 2^zoom square block, drawing each block in
+// the colour of its most numerous race with a character for how full it
+// is on a log scale. Zooming and panning only redraw the visible blocks.
+class GameView : public GameObserver {
+private:
+    UIDisplay *display;
+    
+    int boardWidth;
+    int boardHeight;
+    
+    int worldWidth;
+    int worldHeight;
+    
+    std::unique_ptr<GameDensity> density;
+    
+    int     zoom    = 0;
+    int64_t originX = 0;
+    int64_t originY = 0;
+    
+    std::chrono::steady_clock::time_point nextFrame;
+    
+    bool suspended = false;
+    
+    std::string status;
+    
+    int statusY;
+    int logTop;
+    
+    std::mutex               logMutex;
+    std::vector<std::string> logLines;
+    std::size_t              logHead  = 0;
+    std::size_t              logCount = 0;
+    bool                     logDirty = false;
+    
+    std::unique_ptr<GameWriter> logWriter;
+    
+    void logLine(std::string &string);
+    void renderLog();
+    
+    bool isVisible(int x, int y);
+    void drawCell(Race &race, Cell &cell);
+    void drawDensity();
+    void scrollTo(Game &game, int zoom, int64_t centerX, int64_t centerY);
+public:
+    GameView(UIDisplay *display, const GameConfig &config);
+    ~GameView();
+    
+    void cellSpawned(Game &game, Race &race, Cell &cell) override;
+    void cellMoved(Game &game, Race &race, Cell &cell, int fromX, int fromY) override;
+    void cellDied(Game &game, Race &race, Cell &cell) override;
+    void raceExtinct(Game &game, Race &race) override;
+    void raceDisqualified(Game &game, Race &race, const GameFault &fault) override;
+    void moveEnded(Game &game) override;
+    
+    void setSuspended(bool suspended) {this->suspended = suspended;}
+    void redraw(Game &game);
+    
+    bool        canZoom() {return density != nullptr;}
+    int         getZoom() {return zoom;}
+    void        setZoom(Game &game, int zoom);
+    void        pan(Game &game, int dx, int dy);
+    std::string viewport();
+    
+    void setStatus(const std::string &status);
+    
+    void log(const char *msg);
+    void log(const std::string &msg);
+    void syncLog();
+};
+
+
+#endif
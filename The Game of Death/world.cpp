@@ -0,0 +1,142 @@
+#include "world.hpp"
+#include <algorithm>
+
+using std::size_t;
+
+
+GameWorld::GameWorld(int width, int height) {
+    this->width  = width;
+    this->height = height;
+    
+    dense = (uint64_t)width * height <= GameWorldDenseSquares;
+    if (dense) {
+        squares.resize((size_t)width * height);
+        empties.resize(squares.size());
+        emptyIndex.resize(squares.size());
+    }
+    
+    clear();
+}
+
+GameWorld::Tile *GameWorld::tileAt(int x, int y, bool create) {
+    uint64_t key = tileKey(x, y);
+    if (key == lastKey)
+        return lastTile;
+    
+    auto tile = tiles.find(key);
+    if (tile == tiles.end()) {
+        if (!create)
+            return nullptr;
+        
+        tile = tiles.insert(std::make_pair(key, std::unique_ptr<Tile>(new Tile))).first;
+    }
+    
+    lastKey  = key;
+    lastTile = tile->second.get();
+    
+    return lastTile;
+}
+
+GameSquare *GameWorld::find(int x, int y) {
+    if (!contains(x, y))
+        return nullptr;
+    
+    GameSquare *square;
+    if (dense)
+        square = &squares[(size_t)y * width + x];
+    else {
+        Tile *tile = tileAt(x, y, false);
+        if (!tile)
+            return nullptr;
+        
+        square = &tile->squares[(y & (GameWorldTileSize - 1)) * GameWorldTileSize + (x & (GameWorldTileSize - 1))];
+    }
+    
+    return square->race == RaceIDNone ? nullptr : square;
+}
+
+bool GameWorld::put(int x, int y, GameSquare square) {
+    if (!contains(x, y))
+        return false;
+    
+    GameSquare *slot;
+    if (dense) {
+        uint32_t index = (uint32_t)y * width + x;
+        slot = &squares[index];
+        
+        if (slot->race == RaceIDNone) {
+            uint32_t last = empties.back();
+            empties[emptyIndex[index]] = last;
+            emptyIndex[last] = emptyIndex[index];
+            empties.pop_back();
+        }
+    } else {
+        Tile *tile = tileAt(x, y, true);
+        slot = &tile->squares[(y & (GameWorldTileSize - 1)) * GameWorldTileSize + (x & (GameWorldTileSize - 1))];
+        
+        if (slot->race == RaceIDNone)
+            tile->count++;
+    }
+    
+    if (slot->race == RaceIDNone)
+        occupied++;
+    
+    *slot = square;
+    return true;
+}
+
+void GameWorld::erase(int x, int y) {
+    if (!contains(x, y))
+        return;
+    
+    if (dense) {
+        uint32_t index = (uint32_t)y * width + x;
+        if (squares[index].race == RaceIDNone)
+            return;
+        
+        squares[index] = GameSquare();
+        emptyIndex[index] = (uint32_t)empties.size();
+        empties.push_back(index);
+        occupied--;
+        return;
+    }
+    
+    Tile *tile = tileAt(x, y, false);
+    if (!tile)
+        return;
+    
+    GameSquare &slot = tile->squares[(y & (GameWorldTileSize - 1)) * GameWorldTileSize + (x & (GameWorldTileSize - 1))];
+    if (slot.race == RaceIDNone)
+        return;
+    
+    slot = GameSquare();
+    occupied--;
+    
+    if (--tile->count == 0) {
+        tiles.erase(tileKey(x, y));
+        lastKey  = UINT64_MAX;
+        lastTile = nullptr;
+    }
+}
+
+void GameWorld::emptySquare(size_t index, int &x, int &y) {
+    x = (int)(empties[index] % width);
+    y = (int)(empties[index] / width);
+}
+
+void GameWorld::clear() {
+    if (dense) {
+        std::fill(squares.begin(), squares.end(), GameSquare());
+        
+        empties.resize(squares.size());
+        for (uint32_t i = 0; i < empties.size(); i++) {
+            empties[i]    = i;
+            emptyIndex[i] = i;
+        }
+    }
+    
+    occupied = 0;
+    tiles.clear();
+    lastKey  = UINT64_MAX;
+    lastTile = nullptr;
+}
@@ -0,0 +1,78 @@
+#ifndef WORLD_HPP
+#define WORLD_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+
+typedef uint16_t RaceID;
+static const RaceID RaceIDNone = UINT16_MAX;
+
+typedef struct GameSquare {
+    RaceID   race = RaceIDNone;
+    uint32_t cell = 0;
+} GameSquare;
+
+static const uint64_t GameWorldDenseSquares = 1 << 20;
+static const int      GameWorldTileShift    = 4;
+static const int      GameWorldTileSize     = 1 << GameWorldTileShift;
+
+// Maps occupied squares to the race and index of the cell standing there.
+// Boards up to GameWorldDenseSquares are a flat array, with the empty
+// squares also kept in a swap-remove array for O(1) random picks; larger
+// ones are a hash of GameWorldTileSize square tiles, allocated when the
+// first cell arrives and freed when the last one leaves. Tiles are kept
+// small, 2 KB each, since scattered cells on a huge board mostly get one
+// to themselves. Random empty picks on sparse boards are rejection
+// sampled; the empty list only exists for dense ones.
+class GameWorld {
+private:
+    typedef struct Tile {
+        GameSquare squares[GameWorldTileSize * GameWorldTileSize];
+        int        count = 0;
+    } Tile;
+    
+    int  width;
+    int  height;
+    bool dense;
+    
+    std::vector<GameSquare> squares;
+    std::vector<uint32_t>   empties;
+    std::vector<uint32_t>   emptyIndex;
+    uint64_t                occupied = 0;
+    
+    std::unordered_map<uint64_t, std::unique_ptr<Tile>> tiles;
+    uint64_t lastKey  = UINT64_MAX;
+    Tile    *lastTile = nullptr;
+    
+    uint64_t tileKey(int x, int y) {
+        return ((uint64_t)(uint32_t)(y >> GameWorldTileShift) << 32) | (uint32_t)(x >> GameWorldTileShift);
+    }
+    
+    Tile *tileAt(int x, int y, bool create);
+public:
+    GameWorld(int width, int height);
+    
+    bool isDense() {return dense;}
+    
+    bool contains(int x, int y) {
+        return x >= 0 && x < width && y >= 0 && y < height;
+    }
+    
+    GameSquare *find(int x, int y);
+    bool        put(int x, int y, GameSquare square);
+    void        erase(int x, int y);
+    void        clear();
+    
+    uint64_t    occupiedCount() {return occupied;}
+    std::size_t emptyCount()    {return empties.size();}
+    void        emptySquare(std::size_t index, int &x, int &y);
+    
+    std::size_t tileCount() {return tiles.size();}
+};
+
+
+#endif
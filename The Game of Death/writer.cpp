@@ -0,0 +1,69 @@
+#include "writer.hpp"
+
+using std::size_t;
+using std::string;
+
+
+GameWriter::GameWriter(std::FILE *file, bool closeFile) {
+    this->file      = file;
+    this->closeFile = closeFile;
+    
+    thread = std::thread(&GameWriter::writeLoop, this);
+}
+
+GameWriter::~GameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    
+    ready.notify_one();
+    thread.join();
+    
+    if (closeFile)
+        std::fclose(file);
+}
+
+void GameWriter::write(const char *data, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.append(data, size);
+    }
+    
+    ready.notify_one();
+}
+
+void GameWriter::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this]() {
+        return pending.empty() && !busy;
+    });
+}
+
+void GameWriter::writeLoop() {
+    string buffer;
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [this]() {
+            return !pending.empty() || stopping;
+        });
+        
+        if (pending.empty())
+            break;
+        
+        buffer.swap(pending);
+        busy = true;
+        lock.unlock();
+        
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        std::fflush(file);
+        buffer.clear();
+        
+        lock.lock();
+        busy = false;
+        
+        if (pending.empty())
+            drained.notify_all();
+    }
+}
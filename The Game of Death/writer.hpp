@@ -0,0 +1,38 @@
+#ifndef WRITER_HPP
+#define WRITER_HPP
+
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class GameWriter {
+private:
+    std::FILE *file;
+    bool       closeFile;
+    
+    std::mutex              mutex;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    
+    std::string pending;
+    bool        busy     = false;
+    bool        stopping = false;
+    
+    std::thread thread;
+    void        writeLoop();
+public:
+    GameWriter(std::FILE *file, bool closeFile = false);
+    ~GameWriter();
+    
+    void write(const char *data, std::size_t size);
+    void write(const std::string &data) {write(data.data(), data.size());}
+    
+    void sync();
+};
+
+
+#endif
@@ -1,104 +1,248 @@
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <sstream>
 #include <vector>
-#include <map>
+#include <unordered_map>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 
 
-static void openFailed(const char *fn) {
-    cerr << "Open failed: " << fn << endl;
-    exit(1);
-}
+typedef struct Span {
+    const char *data;
+    size_t      size;
+} Span;
 
-int main(int argc, const char * argv[]) {
-    if (argc != 3) {
-        cerr << "Usage: deathac <infile> <outfile>" << endl;
-        return 1;
+typedef struct SpanHash {
+    size_t operator()(const Span &span) const {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < span.size; i++) {
+            hash ^= (unsigned char)span.data[i];
+            hash *= 0x100000001b3ULL;
+        }
+        
+        return (size_t)hash;
+    }
+} SpanHash;
+
+typedef struct SpanEqual {
+    bool operator()(const Span &a, const Span &b) const {
+        return a.size == b.size && !memcmp(a.data, b.data, a.size);
     }
+} SpanEqual;
+
+typedef struct Fixup {
+    size_t offset;
+    Span   label;
+} Fixup;
+
+typedef struct Job {
+    string input;
+    string output;
+    string error;
+} Job;
+
+
+static void usage() {
+    cerr << "Usage: deathac <infile> <outfile>" << endl
+         << "       deathac -b [-j threads] <infile ...>" << endl
+         << "Batch mode writes each name.dac to name.dasm." << endl;
+}
+
+static bool compile(const string &code, string &output, string &error) {
+    unordered_map<Span, size_t, SpanHash, SpanEqual> labels;
+    vector<Fixup> fixups;
     
-    vector<vector<string>> insns;
+    string body;
+    body.reserve(code.size());
     
-    ifstream autocode(argv[1]);
-    if (autocode.fail())
-        openFailed(argv[1]);
+    const char *p   = code.data();
+    const char *end = p + code.size();
+    size_t      pc  = 0;
     
-    string   line;
-    while (getline(autocode, line)) {
-        vector<string> insn;
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        
+        size_t count = 0;
+        Span   first = {nullptr, 0};
+        size_t line  = body.size();
         
-        size_t i = 0;
-        size_t d;
-        do {
-            string s;
-            d = line.find(' ', i);
-            if (d == s.npos)
-                s = string(line, i);
-            else
-                s = string(line, i, d - i);
+        for (const char *word = p; word < eol;) {
+            const char *space = (const char *)memchr(word, ' ', eol - word);
+            if (!space)
+                space = eol;
+            
+            Span span = {word, (size_t)(space - word)};
+            word = space + 1;
+            
+            if (!span.size)
+                continue;
             
-            if (s.length())
-                insn.push_back(s);
+            if (!count++) {
+                first = span;
+                continue;
+            }
+            
+            if (first.data[0] == '!')
+                continue;
+            
+            if (count == 2)
+                body.append(first.data, first.size);
+            
+            body += ' ';
+            if (span.data[0] == '$') {
+                Fixup fixup = {body.size(), {span.data + 1, span.size - 1}};
+                fixups.push_back(fixup);
+            } else
+                body.append(span.data, span.size);
+        }
+        
+        if (count == 1 && first.data[0] == '!') {
+            Span label = {first.data + 1, first.size - 1};
+            labels[label] = pc;
+        } else if (count) {
+            pc++;
             
-            i = d + 1;
-        } while (d != string::npos);
+            if (first.data[0] == '!')
+                body.resize(line);
+            else {
+                if (count == 1)
+                    body.append(first.data, first.size);
+                body += '\n';
+            }
+        }
         
-        if (insn.size())
-        insns.push_back(insn);
+        p = eol + 1;
     }
     
-    if (autocode.fail() && !autocode.eof()) {
-        cerr << "Read failed: " << argv[1] << endl;
-        return 1;
+    output.clear();
+    output.reserve(body.size() + fixups.size() * 4);
+    
+    size_t copied = 0;
+    for (Fixup &fixup : fixups) {
+        auto label = labels.find(fixup.label);
+        if (label == labels.end()) {
+            error = "Use of undeclared label '" + string(fixup.label.data, fixup.label.size) + "'.";
+            return false;
+        }
+        
+        output.append(body, copied, fixup.offset - copied);
+        output += to_string(label->second);
+        copied = fixup.offset;
+    }
+    
+    output.append(body, copied, string::npos);
+    return true;
+}
+
+static bool compileFile(Job &job) {
+    ifstream input(job.input, ios::binary);
+    if (input.fail()) {
+        job.error = "Open failed: " + job.input;
+        return false;
     }
     
-    autocode.close();
+    stringstream code;
+    code << input.rdbuf();
+    if (input.bad()) {
+        job.error = "Read failed: " + job.input;
+        return false;
+    }
     
-    map<string, size_t> labels;
-    for (size_t i = 0, pc = 0; i < insns.size(); i++) {
-        if (insns[i].size() == 1 && insns[i][0][0] == '!')
-            labels[insns[i][0].substr(1)] = pc;
-        else
-            pc++;
+    string output;
+    if (!compile(code.str(), output, job.error)) {
+        remove(job.output.c_str());
+        return false;
+    }
+    
+    ofstream file(job.output, ios::binary);
+    if (file.fail()) {
+        job.error = "Open failed: " + job.output;
+        return false;
     }
     
-    ofstream output(argv[2]);
-    if (output.fail())
-        openFailed(argv[2]);
+    file.write(output.data(), output.size());
+    file.close();
     
-    for (auto &insn : insns) {
-        if (insn[0][0] == '!')
-            continue;
-        
-        output << insn[0];
+    if (file.fail()) {
+        job.error = "Write failed: " + job.output;
+        remove(job.output.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+static string outputPath(const string &input) {
+    size_t slash = input.rfind('/');
+    size_t dot   = input.rfind('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return input + ".dasm";
+    
+    return input.substr(0, dot) + ".dasm";
+}
+
+int main(int argc, const char * argv[]) {
+    if (argc == 3 && argv[1][0] != '-') {
+        Job job;
+        job.input  = argv[1];
+        job.output = argv[2];
         
-        for (size_t i = 1; i < insn.size(); i++) {
-            if (insn[i][0] == '$') {
-                string label = insn[i].substr(1);
-                
-                if (labels.find(label) == labels.end()) {
-                    cerr << "Use of undeclared label '" << label << "'." << endl;
-                    remove(argv[2]);
-                    return 1;
-                }
-                
-                insn[i] = to_string(labels[label]);
-            }
-            
-            output << " " << insn[i];
-            if (output.fail()) {
-                cerr << "Write failed: " << argv[2] << endl;
-                remove(argv[2]);
-                return 1;
-            }
-        }
+        if (compileFile(job))
+            return 0;
         
-        output << endl;
+        cerr << job.error << endl;
+        return 1;
+    }
+    
+    if (argc < 3 || string(argv[1]) != "-b") {
+        usage();
+        return 1;
+    }
+    
+    size_t threads = thread::hardware_concurrency();
+    
+    int argi = 2;
+    if (string(argv[argi]) == "-j" && argi + 1 < argc) {
+        threads = atol(argv[argi + 1]);
+        argi += 2;
+    }
+    
+    vector<Job> jobs;
+    for (; argi < argc; argi++) {
+        Job job;
+        job.input  = argv[argi];
+        job.output = outputPath(job.input);
+        jobs.push_back(job);
     }
     
-    output.close();
+    threads = max((size_t)1, min(threads, jobs.size()));
+    
+    atomic<size_t> next(0);
+    atomic<bool>   failed(false);
+    mutex          errors;
+    
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++)
+        workers.push_back(thread([&]() {
+            for (size_t i = next++; i < jobs.size(); i = next++)
+                if (!compileFile(jobs[i])) {
+                    failed = true;
+                    
+                    lock_guard<mutex> lock(errors);
+                    cerr << jobs[i].input << ": " << jobs[i].error << endl;
+                }
+        }));
+    
+    for (thread &worker : workers)
+        worker.join();
     
-    return 0;
+    return failed ? 1 : 0;
 }
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include "game.hpp"
+#include "program.hpp"
+#include "reference.hpp"
+
+using namespace std;
+
+
+typedef struct Options {
+    uint64_t seed   = 0;
+    int      moves  = 10000;
+    size_t   every  = 100;
+    size_t   games  = 1;
+    size_t   fuzz   = 0;
+    size_t   races  = 4;
+} Options;
+
+static const size_t FuzzLengthMax = 24;
+
+static const char *const FuzzOps[] = {
+    "eat", "go", "clon", "str", "left", "right", "back", "turn", "jg", "jl", "j", "je"
+};
+
+static const char *const FuzzJunk[] = {
+    "eat r", "str r", "left r", "left 1", "eat 100", "go 0x10", "turn", "turn x",
+    "jg x 0", "jl 5", "j", "j -1", "je 1 2", "clon 3", "nop", "eat 2 3"
+};
+
+
+static void usage() {
+    cerr << "Usage: deathcheck [options] <program.dasm ...>" << endl
+         << "Runs the engine and the reference interpreter in lockstep and" << endl
+         << "reports the first move and cell where their states diverge." << endl
+         << "  -s seed  seed of the first game (0 picks one)" << endl
+         << "  -m n     moves per game (10000)" << endl
+         << "  -n n     compare state hashes every n moves (100)" << endl
+         << "  -g n     games to check, with consecutive seeds (1)" << endl
+         << "  -f n     check n sets of random programs instead of the given ones" << endl
+         << "  -r n     races per random game (4)" << endl;
+}
+
+static string fuzzProgram(GameRandom &rng) {
+    size_t length = 1 + rng.below(FuzzLengthMax);
+    
+    string code;
+    for (size_t i = 0; i < length; i++) {
+        if (!rng.below(100)) {
+            code += FuzzJunk[rng.below(sizeof(FuzzJunk) / sizeof(FuzzJunk[0]))];
+            code += '\n';
+            continue;
+        }
+        
+        string op = FuzzOps[rng.below(sizeof(FuzzOps) / sizeof(FuzzOps[0]))];
+        code += op;
+        
+        uint32_t target = rng.below((uint32_t)length + (rng.below(50) ? 0 : 2));
+        
+        if (op == "eat" || op == "go" || op == "str" || op == "left" || op == "right") {
+            if ((op == "eat" || op == "go") && !rng.below(4))
+                code += " r";
+            else if (rng.below(2))
+                code += " " + to_string(2 + rng.below(98));
+        } else if (op == "turn")
+            code += " r";
+        else if (op == "jg" || op == "jl")
+            code += " " + to_string(rng.below(40)) + " " + to_string(target);
+        else if (op == "j" || op == "je")
+            code += " " + to_string(target);
+        
+        code += '\n';
+    }
+    
+    if (rng.below(10))
+        code += "j 0\n";
+    
+    return code;
+}
+
+template <typename E>
+static string advance(E &engine, size_t n) {
+    try {
+        engine.step(n);
+    } catch (GameExceptionRef exc) {
+        return GameExceptionString(exc);
+    }
+    
+    return string();
+}
+
+static string check(Game &game, const vector<string> &sources, uint64_t seed, const Options &options) {
+    game.reset(seed);
+    unique_ptr<GameReference> reference(new GameReference(game, sources));
+    
+    int good = 0;
+    while (!game.isOver() || !reference->isOver()) {
+        string fault          = advance(game, options.every);
+        string referenceFault = advance(*reference, options.every);
+        
+        if (fault.length() || referenceFault.length()) {
+            if (fault == referenceFault)
+                return "both faulted: " + fault;
+            
+            return "DIVERGED after move " + to_string(good) + ": engine " +
+                   (fault.length() ? fault : "ran on") + ", reference " +
+                   (referenceFault.length() ? referenceFault : "ran on");
+        }
+        
+        if (GameStateHash(game) == reference->hash()) {
+            good = game.currentMove();
+            continue;
+        }
+        
+        game.reset(seed);
+        reference.reset(new GameReference(game, sources));
+        game.step(good);
+        reference->step(good);
+        
+        while (GameStateHash(game) == reference->hash() && !game.isOver()) {
+            game.step();
+            reference->step();
+        }
+        
+        return "DIVERGED at " + reference->diff(game);
+    }
+    
+    return "ok after " + to_string(game.currentMove()) + " moves";
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        string option(argv[argi]);
+        if (argi + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        
+        const char *value = argv[++argi];
+        if (option == "-s")
+            options.seed = strtoull(value, nullptr, 0);
+        else if (option == "-m")
+            options.moves = max(1, atoi(value));
+        else if (option == "-n")
+            options.every = max((size_t)1, (size_t)atol(value));
+        else if (option == "-g")
+            options.games = atol(value);
+        else if (option == "-f")
+            options.fuzz = atol(value);
+        else if (option == "-r")
+            options.races = max((size_t)1, (size_t)atol(value));
+        else {
+            usage();
+            return 1;
+        }
+    }
+    
+    if (argi >= argc && !options.fuzz) {
+        usage();
+        return 1;
+    }
+    
+    if (!options.seed)
+        options.seed = GameRandomSeed();
+    
+    vector<string> sources;
+    vector<string> paths;
+    for (int i = argi; i < argc; i++) {
+        ifstream file(argv[i]);
+        stringstream code;
+        code << file.rdbuf();
+        
+        if (file.fail()) {
+            cerr << GameErrorString(GameErrorReadFailed) << " " << argv[i] << endl;
+            return 1;
+        }
+        
+        sources.push_back(code.str());
+        paths.push_back(argv[i]);
+    }
+    
+    GameConfig config;
+    config.moveNumber = options.moves;
+    
+    GameProgramCache programs;
+    bool diverged = false;
+    
+    size_t sets = options.fuzz ? options.fuzz : 1;
+    for (size_t set = 0; set < sets; set++) {
+        uint64_t seed = options.seed + set * options.games;
+        
+        if (options.fuzz) {
+            GameRandom rng;
+            rng.seed(seed);
+            
+            sources.clear();
+            paths.clear();
+            for (size_t i = 0; i < options.races; i++) {
+                sources.push_back(fuzzProgram(rng));
+                paths.push_back("fuzz-" + to_string(seed) + "-" + to_string(i) + ".dasm");
+            }
+        }
+        
+        Game game(config);
+        for (size_t i = 0; i < sources.size(); i++)
+            game.addRace(paths[i], programs.parse(sources[i]));
+        
+        for (size_t g = 0; g < options.games; g++) {
+            string result = check(game, sources, seed + g, options);
+            cout << "seed " << seed + g << ": " << result << endl;
+            
+            if (result.compare(0, 8, "DIVERGED"))
+                continue;
+            
+            diverged = true;
+            
+            if (options.fuzz)
+                for (size_t i = 0; i < sources.size(); i++) {
+                    ofstream(paths[i]) << sources[i];
+                    cout << "  wrote " << paths[i] << endl;
+                }
+        }
+    }
+    
+    return diverged ? 1 : 0;
+}
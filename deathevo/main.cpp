@@ -0,0 +1,459 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "game.hpp"
+#include "program.hpp"
+
+using namespace std;
+
+
+typedef shared_ptr<GameProgram> ProgramRef;
+
+typedef struct Genome {
+    ProgramRef program;
+    double     fitness = 0;
+} Genome;
+
+typedef struct Options {
+    size_t   population  = 64;
+    size_t   generations = 100;
+    size_t   games       = 16;
+    int      moves       = 2000;
+    size_t   threads     = thread::hardware_concurrency();
+    uint64_t seed        = 0;
+    string   checkpoint  = "deathevo.ckpt";
+    string   output      = "best.dasm";
+} Options;
+
+static const size_t GenomeLengthMin = 2;
+static const size_t GenomeLengthMax = 64;
+static const size_t EliteCount      = 2;
+static const size_t TournamentSize  = 3;
+
+
+static void usage() {
+    cerr << "Usage: deathevo [options] <opponent.dasm ...>" << endl
+         << "  -p n     population size (64)" << endl
+         << "  -g n     generations to run (100)" << endl
+         << "  -n n     matches per candidate and generation (16)" << endl
+         << "  -m n     moves per match (2000)" << endl
+         << "  -j n     worker threads (one per core)" << endl
+         << "  -s seed  search seed (0 picks one)" << endl
+         << "  -c path  checkpoint file, resumed if present (deathevo.ckpt)" << endl
+         << "  -o path  where to write the best program (best.dasm)" << endl;
+}
+
+static uint64_t matchSeed(uint64_t seed, size_t generation, size_t match) {
+    GameRandom rng;
+    rng.seed(seed ^ ((uint64_t)generation << 32) ^ match);
+    
+    uint64_t result = ((uint64_t)rng.next() << 32) | rng.next();
+    return result ? result : 1;
+}
+
+static void clampAddresses(GameProgram &program) {
+    size_t length = program.insn.size();
+    for (GameInsn &insn : program.insn)
+        if (insn.addr >= length)
+            insn.addr %= length;
+}
+
+static GameInsn randomInsn(GameRandom &rng, size_t length) {
+    GameInsn insn;
+    insn.op = (GameOp)rng.below(GameOpMax + 1);
+    
+    switch (insn.op) {
+        case GameOpEat:
+        case GameOpGo:
+        case GameOpStr:
+        case GameOpLeft:
+        case GameOpRight:
+            if (insn.op <= GameOpGo && !rng.below(6))
+                insn.random = true;
+            else
+                insn.count = rng.below(2) ? 1 : 2 + rng.below(98);
+            break;
+        case GameOpTurn:
+            insn.random = true;
+            break;
+        case GameOpJg:
+        case GameOpJl:
+            insn.count = rng.below(100);
+            insn.addr  = rng.below((uint32_t)length);
+            break;
+        case GameOpJ:
+        case GameOpJe:
+            insn.addr = rng.below((uint32_t)length);
+            break;
+        default:
+            break;
+    }
+    
+    return insn;
+}
+
+static ProgramRef randomProgram(GameRandom &rng) {
+    ProgramRef program(new GameProgram);
+    
+    size_t length = GenomeLengthMin + rng.below(GenomeLengthMax / 2);
+    for (size_t i = 0; i < length; i++)
+        program->insn.push_back(randomInsn(rng, length));
+    
+    return program;
+}
+
+static void mutate(GameProgram &program, GameRandom &rng) {
+    vector<GameInsn> &insn = program.insn;
+    size_t i = rng.below((uint32_t)insn.size());
+    
+    switch (rng.below(4)) {
+        case 0:
+            insn[i] = randomInsn(rng, insn.size());
+            break;
+        case 1:
+            if (insn[i].op == GameOpJg || insn[i].op == GameOpJl ||
+                insn[i].op == GameOpJ  || insn[i].op == GameOpJe)
+                insn[i].addr = rng.below((uint32_t)insn.size());
+            else if (insn[i].count > 1)
+                insn[i].count = max(2, min(99, insn[i].count + (int)rng.below(11) - 5));
+            break;
+        case 2:
+            if (insn.size() >= GenomeLengthMax)
+                break;
+        
+            for (GameInsn &other : insn)
+                if (other.addr >= i)
+                    other.addr++;
+        
+            insn.insert(insn.begin() + i, randomInsn(rng, insn.size() + 1));
+            break;
+        case 3:
+            if (insn.size() <= GenomeLengthMin)
+                break;
+        
+            insn.erase(insn.begin() + i);
+        
+            for (GameInsn &other : insn)
+                if (other.addr > i)
+                    other.addr--;
+            break;
+    }
+    
+    clampAddresses(program);
+}
+
+static ProgramRef crossover(const GameProgram &a, const GameProgram &b, GameRandom &rng) {
+    ProgramRef child(new GameProgram);
+    
+    size_t cutA = 1 + rng.below((uint32_t)a.insn.size());
+    size_t cutB = rng.below((uint32_t)b.insn.size());
+    
+    child->insn.assign(a.insn.begin(), a.insn.begin() + cutA);
+    child->insn.insert(child->insn.end(), b.insn.begin() + cutB, b.insn.end());
+    
+    if (child->insn.size() > GenomeLengthMax)
+        child->insn.resize(GenomeLengthMax);
+    
+    clampAddresses(*child);
+    
+    return child;
+}
+
+static const Genome &tournament(const vector<Genome> &population, GameRandom &rng) {
+    const Genome *best = nullptr;
+    for (size_t i = 0; i < TournamentSize; i++) {
+        const Genome &genome = population[rng.below((uint32_t)population.size())];
+        if (!best || genome.fitness > best->fitness)
+            best = &genome;
+    }
+    
+    return *best;
+}
+
+static double evaluate(Game &game, const Options &options, ProgramRef program, size_t generation) {
+    program->fuse();
+    game.raceWithIndex(0).program = program;
+    
+    double score = 0;
+    for (size_t match = 0; match < options.games; match++) {
+        game.reset(matchSeed(options.seed, generation, match));
+        
+        try {
+            while (!game.isOver())
+                game.step(1024);
+        } catch (GameExceptionRef exc) {
+            continue;
+        }
+        
+        Race &candidate = game.raceWithIndex(0);
+        if (candidate.extinct) {
+            score += 0.5 * candidate.extinctionDate / options.moves;
+            continue;
+        }
+        
+        long biomass = 0;
+        for (size_t i = 0; i < game.raceCount(); i++)
+            biomass += game.raceWithIndex(i).stats().biomass;
+        
+        score += 1 + (double)candidate.stats().biomass / max(biomass, 1L);
+    }
+    
+    return score / options.games;
+}
+
+static void evaluatePopulation(vector<unique_ptr<Game>> &engines, const Options &options,
+                               vector<Genome> &population, size_t generation) {
+    atomic<size_t> next(0);
+    
+    vector<thread> workers;
+    for (auto &engine : engines) {
+        Game *game = engine.get();
+        workers.push_back(thread([&, game]() {
+            for (size_t i = next++; i < population.size(); i = next++)
+                population[i].fitness = evaluate(*game, options, population[i].program, generation);
+        }));
+    }
+    
+    for (thread &worker : workers)
+        worker.join();
+}
+
+static bool writeAtomically(const string &path, const string &contents) {
+    string tmp = path + ".tmp";
+    
+    ofstream output(tmp);
+    output << contents;
+    output.close();
+    
+    if (output.fail()) {
+        cerr << "Write failed: " << tmp << endl;
+        return false;
+    }
+    
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static bool saveCheckpoint(const Options &options, const vector<Genome> &population,
+                           size_t generation, const GameRandom &rng) {
+    ostringstream output;
+    output << "deathevo 1" << endl
+           << "seed " << options.seed << endl
+           << "generation " << generation << endl
+           << "rng " << rng.state << endl
+           << "population " << population.size() << endl;
+    
+    for (const Genome &genome : population) {
+        output << "program " << genome.program->insn.size() << endl;
+        genome.program->write(output);
+    }
+    
+    return writeAtomically(options.checkpoint, output.str());
+}
+
+static bool loadCheckpoint(Options &options, vector<Genome> &population,
+                           size_t &generation, GameRandom &rng) {
+    ifstream input(options.checkpoint);
+    if (input.fail())
+        return false;
+    
+    string magic, version, seedWord, generationWord, rngWord, populationWord;
+    size_t count = 0;
+    input >> magic >> version
+          >> seedWord >> options.seed
+          >> generationWord >> generation
+          >> rngWord >> rng.state
+          >> populationWord >> count;
+    
+    bool valid = input && magic == "deathevo" && version == "1" && seedWord == "seed" &&
+                 generationWord == "generation" && rngWord == "rng" && populationWord == "population" &&
+                 count > EliteCount;
+    
+    population.clear();
+    for (size_t i = 0; i < count && valid; i++) {
+        string word;
+        size_t length = 0;
+        input >> word >> length;
+        input.ignore(1, '\n');
+        
+        string text, line;
+        size_t j = 0;
+        for (; j < length && getline(input, line); j++)
+            text += line + "\n";
+        
+        if (word != "program" || j < length) {
+            valid = false;
+            break;
+        }
+        
+        istringstream code(text);
+        Genome genome;
+        genome.program.reset(new GameProgram);
+        try {
+            genome.program->parse(code);
+        } catch (GameExceptionRef exc) {
+            cerr << GameExceptionString(exc) << endl;
+            valid = false;
+            break;
+        }
+        population.push_back(genome);
+    }
+    
+    if (!valid || population.size() != count) {
+        cerr << "Bad checkpoint: " << options.checkpoint << endl;
+        exit(1);
+    }
+    
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        string option(argv[argi]);
+        if (argi + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        
+        const char *value = argv[++argi];
+        if (option == "-p")
+            options.population = max(EliteCount + 1, (size_t)atol(value));
+        else if (option == "-g")
+            options.generations = atol(value);
+        else if (option == "-n")
+            options.games = max((size_t)1, (size_t)atol(value));
+        else if (option == "-m")
+            options.moves = max(1, atoi(value));
+        else if (option == "-j")
+            options.threads = atol(value);
+        else if (option == "-s")
+            options.seed = strtoull(value, nullptr, 0);
+        else if (option == "-c")
+            options.checkpoint = value;
+        else if (option == "-o")
+            options.output = value;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    
+    if (argi >= argc) {
+        usage();
+        return 1;
+    }
+    
+    if (!options.threads)
+        options.threads = 1;
+    
+    GameProgramCache programs;
+    
+    vector<Race> opponents;
+    for (int i = argi; i < argc; i++) {
+        Race race;
+        try {
+            race.load(argv[i], &programs);
+        } catch (GameExceptionRef exc) {
+            cerr << GameExceptionString(exc) << endl;
+            return 1;
+        }
+        
+        opponents.push_back(race);
+    }
+    
+    GameRandom rng;
+    vector<Genome> population;
+    size_t generation = 0;
+    
+    if (loadCheckpoint(options, population, generation, rng))
+        cout << "Resuming " << options.checkpoint << " at generation " << generation << endl;
+    else {
+        if (!options.seed)
+            options.seed = GameRandomSeed();
+        rng.seed(options.seed);
+        
+        for (size_t i = 0; i < options.population; i++) {
+            Genome genome;
+            if (i % 2 && opponents.size()) {
+                genome.program.reset(new GameProgram(*opponents[i / 2 % opponents.size()].program));
+                if (genome.program->insn.empty())
+                    genome.program = randomProgram(rng);
+                mutate(*genome.program, rng);
+            } else
+                genome.program = randomProgram(rng);
+            
+            population.push_back(genome);
+        }
+    }
+    
+    GameConfig config;
+    config.moveNumber = options.moves;
+    
+    vector<unique_ptr<Game>> engines;
+    for (size_t i = 0; i < options.threads; i++) {
+        unique_ptr<Game> game(new Game(config));
+        
+        Race candidate;
+        candidate.name = "candidate";
+        game->addRace(candidate);
+        
+        for (Race &opponent : opponents)
+            game->addRace(opponent);
+        
+        engines.push_back(move(game));
+    }
+    
+    for (; generation < options.generations; generation++) {
+        evaluatePopulation(engines, options, population, generation);
+        
+        stable_sort(population.begin(), population.end(), [](const Genome &a, const Genome &b) {
+            return a.fitness > b.fitness;
+        });
+        
+        double mean = 0;
+        for (const Genome &genome : population)
+            mean += genome.fitness;
+        mean /= population.size();
+        
+        cout << "generation " << generation
+             << " best " << population[0].fitness
+             << " mean " << mean << endl;
+        
+        ostringstream best;
+        population[0].program->write(best);
+        writeAtomically(options.output, best.str());
+        
+        vector<Genome> next(population.begin(), population.begin() + EliteCount);
+        while (next.size() < population.size()) {
+            const Genome &a = tournament(population, rng);
+            
+            Genome child;
+            if (rng.below(10) < 7)
+                child.program = crossover(*a.program, *tournament(population, rng).program, rng);
+            else
+                child.program.reset(new GameProgram(*a.program));
+            
+            for (uint32_t i = 1 + rng.below(3); i; i--)
+                mutate(*child.program, rng);
+            
+            next.push_back(child);
+        }
+        
+        population.swap(next);
+        
+        if (!saveCheckpoint(options, population, generation + 1, rng))
+            return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,933 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "game.hpp"
+#include "program.hpp"
+#include "heatmap.hpp"
+
+using namespace std;
+
+
+typedef struct Options {
+    string     listen;
+    string     connect;
+    size_t     local      = 0;
+    size_t     group      = 2;
+    size_t     rounds     = 1;
+    int        moves      = 2000;
+    int        width      = GameBoxWidth;
+    int        height     = GameBoxHeight;
+    int        population = GameInitialPopulation;
+    GameLayout layout     = GameLayoutUniform;
+    uint64_t   seed       = 0;
+    int        lease      = 10;
+    size_t     attempts   = 5;
+    double     alpha      = 0;
+    string     output;
+    string     heatmap;
+} Options;
+
+typedef struct Entrant {
+    string name;
+    string code;
+} Entrant;
+
+typedef struct Standing {
+    RaceID id;
+    bool   extinct;
+    int    extinctionDate;
+    long   biomass;
+    size_t cells;
+} Standing;
+
+typedef struct Job {
+    vector<size_t>   entrants;
+    uint64_t         seed;
+    size_t           group;
+    size_t           round;
+    size_t           attempts = 0;
+    bool             done     = false;
+    bool             skipped  = false;
+    
+    shared_ptr<GameHeatmap> heatmap;
+    int              move     = 0;
+    vector<Standing> standings;
+} Job;
+
+// The matches between one set of programs, by round. The leading rounds
+// that have finished are folded into net, each seat pair's wins minus
+// losses, in round order, so when the group is decided does not depend on
+// which worker finished first.
+typedef struct Group {
+    vector<size_t> entrants;
+    vector<size_t> jobs;
+    vector<long>   net;
+    size_t         counted = 0;
+    bool           decided = false;
+} Group;
+
+typedef struct Worker {
+    int    fd;
+    string name;
+    string input;
+    bool   greeted = false;
+    size_t job     = SIZE_MAX;
+    
+    chrono::steady_clock::time_point heard;
+} Worker;
+
+typedef struct Score {
+    size_t matches = 0;
+    size_t wins    = 0;
+    long   points  = 0;
+    long   biomass = 0;
+} Score;
+
+static const int HeartbeatInterval = 1;
+static const int ConnectRetries    = 50;
+
+static const double SequentialMargin = 0.1;
+
+
+static void usage() {
+    cerr << "Usage: deathtour -c addr [options] <program.dasm ...>" << endl
+         << "       deathtour -w addr" << endl
+         << "Plays every group of programs against each other, farming the" << endl
+         << "matches out to workers that connect to the coordinator." << endl
+         << "  -c addr  coordinate on a TCP port or host:port" << endl
+         << "  -w addr  work for the coordinator at host:port" << endl
+         << "  -j n     also fork n local workers (0)" << endl
+         << "  -k n     programs per match (2)" << endl
+         << "  -n n     matches per group, with different seeds (1)" << endl
+         << "  -e rate  stop a group early once every pairing in it is decided," << endl
+         << "           wrongly at most this often (off)" << endl
+         << "  -m n     moves per match (2000)" << endl
+         << "  -b WxH   board size in squares" << endl
+         << "  -p n     starting cells per race" << endl
+         << "  -L name  starting layout: uniform, quadrant, clustered or symmetric" << endl
+         << "  -s seed  tournament seed (0 picks one)" << endl
+         << "  -l secs  reassign a match when its worker is silent this long (10)" << endl
+         << "  -a n     give up on a match after it lost n workers (5)" << endl
+         << "  -o path  write per-match results as CSV" << endl
+         << "  -H path  write heatmaps merged over the counted matches (.txt for text)" << endl;
+}
+
+static uint64_t matchSeed(uint64_t seed, size_t match) {
+    GameRandom rng;
+    rng.seed(seed ^ ((uint64_t)match << 32));
+    
+    uint64_t result = ((uint64_t)rng.next() << 32) | rng.next();
+    return result ? result : 1;
+}
+
+static bool sendAll(int fd, const string &data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        
+        sent += n;
+    }
+    
+    return true;
+}
+
+static bool splitAddress(const string &address, string &host, string &port) {
+    size_t colon = address.rfind(':');
+    host = colon == string::npos ? "" : address.substr(0, colon);
+    port = colon == string::npos ? address : address.substr(colon + 1);
+    
+    return port.length();
+}
+
+static int listenOn(const string &address) {
+    string host, port;
+    if (!splitAddress(address, host, port))
+        return -1;
+    
+    addrinfo hints, *info;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    
+    if (getaddrinfo(host.length() ? host.c_str() : nullptr, port.c_str(), &hints, &info))
+        return -1;
+    
+    int one = 1;
+    int fd  = socket(info->ai_family, info->ai_socktype, 0);
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd >= 0 && (bind(fd, info->ai_addr, info->ai_addrlen) < 0 || listen(fd, 64) < 0)) {
+        close(fd);
+        fd = -1;
+    }
+    
+    freeaddrinfo(info);
+    return fd;
+}
+
+static int connectTo(const string &address) {
+    string host, port;
+    if (!splitAddress(address, host, port))
+        return -1;
+    
+    addrinfo hints, *info;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    if (getaddrinfo(host.length() ? host.c_str() : "127.0.0.1", port.c_str(), &hints, &info))
+        return -1;
+    
+    int fd = socket(info->ai_family, info->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    
+    freeaddrinfo(info);
+    return fd;
+}
+
+
+// The protocol is line based. A worker says HELLO, and the coordinator
+// answers with CONFIG, the programs as PROGRAM headers followed by their
+// name and source (both length prefixed, since file names may hold spaces),
+// and then one JOB at a time. While playing, the worker sends BUSY
+// every HeartbeatInterval seconds so its lease stays fresh, and finally
+// RESULT with each seat's extinction date, biomass and cell count, after
+// a HEATMAP header and the binary heatmap if CONFIG asked for one. DONE
+// sends the worker home.
+class Connection {
+private:
+    int    fd;
+    string buffer;
+    
+    bool fill() {
+        char    chunk[1 << 16];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0)
+            return false;
+        
+        buffer.append(chunk, n);
+        return true;
+    }
+public:
+    Connection(int fd) : fd(fd) {}
+    
+    bool readLine(string &line) {
+        size_t lf;
+        while ((lf = buffer.find('\n')) == string::npos)
+            if (!fill())
+                return false;
+        
+        line = buffer.substr(0, lf);
+        buffer.erase(0, lf + 1);
+        return true;
+    }
+    
+    bool readBytes(size_t length, string &bytes) {
+        while (buffer.size() < length)
+            if (!fill())
+                return false;
+        
+        bytes = buffer.substr(0, length);
+        buffer.erase(0, length);
+        return true;
+    }
+};
+
+static string playJob(int fd, const GameConfig &config, bool heat, const vector<GameProgramRef> &programs,
+                      const vector<string> &names, size_t id, uint64_t seed, const vector<size_t> &seats) {
+    GameConfig matchConfig = config;
+    matchConfig.seed = seed;
+    
+    Game game(matchConfig);
+    for (size_t seat : seats)
+        game.addRace(names[seat], programs[seat]);
+    
+    unique_ptr<GameHeatmap> heatmap;
+    if (heat) {
+        heatmap.reset(new GameHeatmap(game));
+        game.addObserver(heatmap.get());
+    }
+    
+    auto beat = chrono::steady_clock::now() + chrono::seconds(HeartbeatInterval);
+    
+    RaceID forfeit = RaceIDNone;
+    try {
+        while (!game.isOver()) {
+            game.step(256);
+            
+            if (chrono::steady_clock::now() >= beat) {
+                if (!sendAll(fd, "BUSY " + to_string(id) + " " + to_string(game.currentMove()) + "\n"))
+                    return string();
+                beat = chrono::steady_clock::now() + chrono::seconds(HeartbeatInterval);
+            }
+        }
+    } catch (GameExceptionRef exc) {
+        forfeit = exc.race;
+    }
+    
+    for (const GameFault &fault : game.getFaults())
+        cerr << GameFaultString(game, fault) << endl;
+    
+    ostringstream result;
+    if (heatmap) {
+        string data;
+        heatmap->settle(game);
+        heatmap->write(data);
+        
+        result << "HEATMAP " << id << " " << data.size() << "\n" << data;
+    }
+    
+    result << "RESULT " << id << " " << game.currentMove();
+    
+    for (size_t i = 0; i < game.raceCount(); i++) {
+        Race     &race  = game.raceWithIndex(i);
+        RaceStats stats = race.stats();
+        
+        int extinctionDate = race.extinctionDate;
+        if ((race.extinct || race.id == forfeit) && extinctionDate == RaceExtinctionDateNone)
+            extinctionDate = game.currentMove() + 1;
+        
+        if (race.id == forfeit)
+            result << " " << extinctionDate << " 0 0";
+        else
+            result << " " << extinctionDate << " " << stats.biomass << " " << stats.cells;
+    }
+    
+    result << "\n";
+    return result.str();
+}
+
+static int work(const string &address) {
+    int fd = -1;
+    for (int i = 0; i < ConnectRetries && (fd = connectTo(address)) < 0; i++)
+        usleep(100000);
+    
+    if (fd < 0) {
+        cerr << "Connect failed: " << address << endl;
+        return 1;
+    }
+    
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    
+    if (!sendAll(fd, "HELLO " + string(host) + ":" + to_string(getpid()) + "\n")) {
+        close(fd);
+        return 1;
+    }
+    
+    Connection connection(fd);
+    
+    GameConfig             config;
+    bool                   heat = false;
+    GameProgramCache       cache;
+    vector<GameProgramRef> programs;
+    vector<string>         names;
+    
+    string line;
+    while (connection.readLine(line)) {
+        istringstream words(line);
+        string verb;
+        words >> verb;
+        
+        if (verb == "CONFIG") {
+            size_t count = 0;
+            string layout;
+            words >> config.moveNumber >> config.width >> config.height >> config.initialPopulation >> count >> layout >> heat;
+            GameLayoutFromString(layout, config.layout);
+            
+            programs.assign(count, nullptr);
+            names.assign(count, string());
+        } else if (verb == "PROGRAM") {
+            size_t index = 0, nameLength = 0, codeLength = 0;
+            string name, code;
+            words >> index >> nameLength >> codeLength;
+            
+            if (!words || index >= programs.size() ||
+                !connection.readBytes(nameLength, name) || !connection.readBytes(codeLength, code))
+                break;
+            
+            try {
+                programs[index] = cache.parse(code);
+            } catch (GameExceptionRef exc) {
+                cerr << name << ": " << GameExceptionString(exc) << endl;
+                break;
+            }
+            names[index] = name;
+        } else if (verb == "JOB") {
+            size_t   id   = 0;
+            uint64_t seed = 0;
+            words >> id >> seed;
+            
+            vector<size_t> seats;
+            for (size_t seat; words >> seat;)
+                if (seat < programs.size() && programs[seat])
+                    seats.push_back(seat);
+            
+            string result = playJob(fd, config, heat, programs, names, id, seed, seats);
+            if (result.empty() || !sendAll(fd, result))
+                break;
+        } else if (verb == "DONE")
+            break;
+    }
+    
+    close(fd);
+    return 0;
+}
+
+
+static int compare(const Standing &x, const Standing &y) {
+    if (x.extinct != y.extinct)
+        return x.extinct ? -1 : 1;
+    if (x.extinct)
+        return (x.extinctionDate > y.extinctionDate) - (x.extinctionDate < y.extinctionDate);
+    return (x.biomass > y.biomass) - (x.biomass < y.biomass);
+}
+
+static void placings(const Job &job, vector<size_t> &order) {
+    order.resize(job.standings.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    
+    stable_sort(order.begin(), order.end(), [&job](size_t a, size_t b) {
+        return compare(job.standings[a], job.standings[b]) > 0;
+    });
+}
+
+// A sequential probability ratio test per pairing, between win rates of
+// 0.5 + SequentialMargin and 0.5 - SequentialMargin with both error rates
+// alpha. Each placing moves the log likelihood ratio by the same step, so
+// the test comes down to a bound on net wins. Draws carry no evidence.
+static double sequentialBound(double alpha) {
+    return log((1 - alpha) / alpha) / log((0.5 + SequentialMargin) / (0.5 - SequentialMargin));
+}
+
+static size_t fold(const Options &options, Group &group, vector<Job> &jobs, GameHeatmap &heatmap) {
+    size_t k = group.entrants.size();
+    
+    while (!group.decided && group.counted < group.jobs.size() && jobs[group.jobs[group.counted]].done) {
+        Job &job = jobs[group.jobs[group.counted++]];
+        
+        if (job.heatmap) {
+            if (!heatmap.merge(*job.heatmap))
+                cerr << "Heatmap of match " << group.jobs[group.counted - 1] << " does not fit the others" << endl;
+            job.heatmap.reset();
+        }
+        
+        vector<size_t> seat(k);
+        for (size_t i = 0; i < k; i++)
+            seat[i] = find(group.entrants.begin(), group.entrants.end(), job.entrants[i]) - group.entrants.begin();
+        
+        for (size_t i = 0; i < k; i++) {
+            for (size_t j = 0; j < k; j++) {
+                int result = compare(job.standings[i], job.standings[j]);
+                group.net[seat[i] * k + seat[j]] += result;
+            }
+        }
+        
+        if (options.alpha > 0) {
+            double bound = sequentialBound(options.alpha);
+            
+            group.decided = true;
+            for (size_t i = 0; i < k * k; i++)
+                if (i / k != i % k && labs(group.net[i]) < bound)
+                    group.decided = false;
+        }
+    }
+    
+    size_t skipped = 0;
+    if (group.decided) {
+        for (size_t round = group.counted; round < group.jobs.size(); round++) {
+            Job &job = jobs[group.jobs[round]];
+            job.heatmap.reset();
+            
+            if (!job.done && !job.skipped) {
+                job.skipped = true;
+                skipped++;
+            }
+        }
+    }
+    
+    return skipped;
+}
+
+
+static bool parseResult(istringstream &words, Job &job) {
+    words >> job.move;
+    
+    job.standings.clear();
+    for (size_t i = 0; i < job.entrants.size(); i++) {
+        Standing standing;
+        standing.id = (RaceID)i;
+        
+        if (!(words >> standing.extinctionDate >> standing.biomass >> standing.cells))
+            return false;
+        standing.extinct = standing.extinctionDate != RaceExtinctionDateNone;
+        
+        job.standings.push_back(standing);
+    }
+    
+    return true;
+}
+
+static void drop(vector<Worker> &workers, size_t index, vector<Job> &jobs, deque<size_t> &pending) {
+    Worker &worker = workers[index];
+    
+    if (worker.job != SIZE_MAX && !jobs[worker.job].done && !jobs[worker.job].skipped) {
+        cerr << "Lost " << (worker.name.length() ? worker.name : "a worker") << ", match " << worker.job << " goes back in the queue" << endl;
+        pending.push_front(worker.job);
+    }
+    
+    close(worker.fd);
+    workers.erase(workers.begin() + index);
+}
+
+static bool assign(Worker &worker, vector<Job> &jobs, deque<size_t> &pending) {
+    while (pending.size() && (jobs[pending.front()].done || jobs[pending.front()].skipped))
+        pending.pop_front();
+    
+    if (pending.empty()) {
+        worker.job = SIZE_MAX;
+        return true;
+    }
+    
+    size_t id = pending.front();
+    pending.pop_front();
+    
+    Job &job = jobs[id];
+    job.attempts++;
+    
+    string line = "JOB " + to_string(id) + " " + to_string(job.seed);
+    for (size_t seat : job.entrants)
+        line += " " + to_string(seat);
+    
+    worker.job   = id;
+    worker.heard = chrono::steady_clock::now();
+    return sendAll(worker.fd, line + "\n");
+}
+
+static bool coordinate(int listenFd, const Options &options, const vector<Entrant> &entrants,
+                       vector<Group> &groups, vector<Job> &jobs, GameHeatmap &heatmap) {
+    string greeting = "CONFIG " + to_string(options.moves) + " " + to_string(options.width) + " " +
+                      to_string(options.height) + " " + to_string(options.population) + " " +
+                      to_string(entrants.size()) + " " + GameLayoutString(options.layout) + " " +
+                      to_string((int)!options.heatmap.empty()) + "\n";
+    for (size_t i = 0; i < entrants.size(); i++)
+        greeting += "PROGRAM " + to_string(i) + " " + to_string(entrants[i].name.size()) + " " +
+                    to_string(entrants[i].code.size()) + "\n" + entrants[i].name + entrants[i].code;
+    
+    deque<size_t> pending;
+    for (size_t round = 0; round < options.rounds; round++)
+        for (Group &group : groups)
+            pending.push_back(group.jobs[round]);
+    
+    vector<Worker> workers;
+    size_t         remaining = jobs.size();
+    
+    while (remaining) {
+        vector<pollfd> fds;
+        fds.push_back({listenFd, POLLIN, 0});
+        for (Worker &worker : workers)
+            fds.push_back({worker.fd, POLLIN, 0});
+        
+        if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR)
+            return false;
+        
+        auto now = chrono::steady_clock::now();
+        
+        for (size_t i = workers.size(); i--;) {
+            Worker &worker = workers[i];
+            
+            if (fds[i + 1].revents) {
+                char    chunk[1 << 16];
+                ssize_t n = read(worker.fd, chunk, sizeof(chunk));
+                if (n <= 0) {
+                    drop(workers, i, jobs, pending);
+                    continue;
+                }
+                
+                worker.input.append(chunk, n);
+                worker.heard = now;
+            } else if (worker.job != SIZE_MAX && now - worker.heard > chrono::seconds(options.lease)) {
+                cerr << worker.name << " is silent" << endl;
+                drop(workers, i, jobs, pending);
+                continue;
+            }
+            
+            bool alive = true;
+            for (size_t lf; alive && (lf = worker.input.find('\n')) != string::npos;) {
+                istringstream words(worker.input.substr(0, lf));
+                
+                string verb;
+                words >> verb;
+                
+                if (verb == "HEATMAP") {
+                    size_t id = SIZE_MAX, length = 0;
+                    words >> id >> length;
+                    
+                    if (worker.input.size() - lf - 1 < length)
+                        break;
+                    
+                    shared_ptr<GameHeatmap> map(new GameHeatmap);
+                    if (id != worker.job || !map->read(worker.input.substr(lf + 1, length))) {
+                        alive = false;
+                        break;
+                    }
+                    
+                    worker.input.erase(0, lf + 1 + length);
+                    
+                    if (!jobs[id].done && !jobs[id].skipped)
+                        jobs[id].heatmap = map;
+                    continue;
+                }
+                
+                worker.input.erase(0, lf + 1);
+                
+                if (verb == "HELLO") {
+                    words >> worker.name;
+                    worker.greeted = true;
+                    alive = sendAll(worker.fd, greeting) && assign(worker, jobs, pending);
+                } else if (verb == "RESULT") {
+                    size_t id = SIZE_MAX;
+                    words >> id;
+                    
+                    if (id != worker.job) {
+                        alive = false;
+                        break;
+                    }
+                    
+                    Job &job = jobs[id];
+                    if (!job.done && !job.skipped) {
+                        if (!parseResult(words, job)) {
+                            alive = false;
+                            break;
+                        }
+                        
+                        job.done = true;
+                        remaining--;
+                        remaining -= fold(options, groups[job.group], jobs, heatmap);
+                    }
+                    
+                    alive = assign(worker, jobs, pending);
+                }
+            }
+            
+            if (!alive)
+                drop(workers, i, jobs, pending);
+        }
+        
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (!jobs[i].done && !jobs[i].skipped && jobs[i].attempts > options.attempts) {
+                cerr << "Match " << i << " lost " << options.attempts << " workers, giving up" << endl;
+                return false;
+            }
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                Worker worker;
+                worker.fd    = fd;
+                worker.heard = now;
+                workers.push_back(worker);
+            }
+        }
+        
+        for (size_t i = workers.size(); i--;)
+            if (workers[i].greeted && workers[i].job == SIZE_MAX && !assign(workers[i], jobs, pending))
+                drop(workers, i, jobs, pending);
+    }
+    
+    for (Worker &worker : workers) {
+        sendAll(worker.fd, "DONE\n");
+        close(worker.fd);
+    }
+    
+    return true;
+}
+
+
+static void schedule(const Options &options, size_t count, vector<Group> &groups, vector<Job> &jobs) {
+    size_t group = min(options.group, count);
+    
+    vector<size_t> seats(group);
+    for (size_t i = 0; i < group; i++)
+        seats[i] = i;
+    
+    while (true) {
+        Group added;
+        added.entrants = seats;
+        added.net.assign(group * group, 0);
+        
+        for (size_t round = 0; round < options.rounds; round++) {
+            Job job;
+            job.entrants = seats;
+            rotate(job.entrants.begin(), job.entrants.begin() + round % group, job.entrants.end());
+            job.seed  = matchSeed(options.seed, jobs.size());
+            job.group = groups.size();
+            job.round = round;
+            
+            added.jobs.push_back(jobs.size());
+            jobs.push_back(job);
+        }
+        
+        groups.push_back(added);
+        
+        size_t i = group;
+        while (i-- && seats[i] == count - group + i);
+        if (i == SIZE_MAX)
+            break;
+        
+        seats[i]++;
+        for (size_t j = i + 1; j < group; j++)
+            seats[j] = seats[j - 1] + 1;
+    }
+}
+
+static void report(const Options &options, const vector<Entrant> &entrants,
+                   const vector<Group> &groups, const vector<Job> &jobs) {
+    vector<Score> scores(entrants.size());
+    
+    ofstream csv;
+    if (options.output.length()) {
+        csv.open(options.output);
+        csv << "match,seed,moves,seat,program,extinction,biomass,cells,rank" << endl;
+    }
+    
+    vector<size_t> order;
+    for (size_t id = 0; id < jobs.size(); id++) {
+        const Job &job = jobs[id];
+        if (job.round >= groups[job.group].counted)
+            continue;
+        
+        placings(job, order);
+        
+        for (size_t place = 0; place < order.size(); place++) {
+            const Standing &standing = job.standings[order[place]];
+            size_t entrant = job.entrants[order[place]];
+            
+            Score &score = scores[entrant];
+            score.matches++;
+            score.points  += (long)(order.size() - place - 1);
+            score.biomass += standing.biomass;
+            if (!place && !standing.extinct)
+                score.wins++;
+            
+            if (csv.is_open())
+                csv << id << "," << job.seed << "," << job.move << "," << order[place] << "," <<
+                       entrants[entrant].name << "," << standing.extinctionDate << "," <<
+                       standing.biomass << "," << standing.cells << "," << place + 1 << endl;
+        }
+    }
+    
+    vector<size_t> table(entrants.size());
+    for (size_t i = 0; i < table.size(); i++)
+        table[i] = i;
+    
+    stable_sort(table.begin(), table.end(), [&scores](size_t a, size_t b) {
+        if (scores[a].points != scores[b].points)
+            return scores[a].points > scores[b].points;
+        return scores[a].biomass > scores[b].biomass;
+    });
+    
+    cout << "Program              Matches  Wins  Points     Biomass" << endl;
+    for (size_t i : table) {
+        char row[128];
+        snprintf(row, sizeof(row), "%-20s %7zu %5zu %7ld %11ld",
+                 entrants[i].name.c_str(), scores[i].matches, scores[i].wins, scores[i].points, scores[i].biomass);
+        cout << row << endl;
+    }
+    
+    if (options.alpha > 0) {
+        size_t stopped = 0, played = 0;
+        for (const Group &group : groups) {
+            stopped += group.counted < group.jobs.size();
+            played  += group.counted;
+        }
+        
+        cout << "Stopped " << stopped << " of " << groups.size() << " groups early, counting " <<
+                played << " of " << jobs.size() << " matches" << endl;
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        string option(argv[argi]);
+        if (argi + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        
+        const char *value = argv[++argi];
+        if (option == "-c")
+            options.listen = value;
+        else if (option == "-w")
+            options.connect = value;
+        else if (option == "-j")
+            options.local = atol(value);
+        else if (option == "-k")
+            options.group = max((size_t)1, (size_t)atol(value));
+        else if (option == "-n")
+            options.rounds = max((size_t)1, (size_t)atol(value));
+        else if (option == "-m")
+            options.moves = max(1, atoi(value));
+        else if (option == "-b") {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2 ||
+                options.width <= 0 || options.height <= 0) {
+                usage();
+                return 1;
+            }
+        } else if (option == "-p")
+            options.population = max(1, atoi(value));
+        else if (option == "-L") {
+            if (!GameLayoutFromString(value, options.layout)) {
+                usage();
+                return 1;
+            }
+        } else if (option == "-s")
+            options.seed = strtoull(value, nullptr, 0);
+        else if (option == "-l")
+            options.lease = max(HeartbeatInterval + 1, atoi(value));
+        else if (option == "-e") {
+            options.alpha = atof(value);
+            if (options.alpha < 0 || options.alpha >= 0.5) {
+                usage();
+                return 1;
+            }
+        } else if (option == "-a")
+            options.attempts = max((size_t)1, (size_t)atol(value));
+        else if (option == "-o")
+            options.output = value;
+        else if (option == "-H")
+            options.heatmap = value;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    
+    if (options.connect.length()) {
+        if (options.listen.length() || argi < argc) {
+            usage();
+            return 1;
+        }
+        
+        return work(options.connect);
+    }
+    
+    if (options.listen.empty() || argi >= argc) {
+        usage();
+        return 1;
+    }
+    
+    if ((size_t)(argc - argi) > RaceCountMax) {
+        cerr << GameErrorString(GameErrorTooManyRaces) << endl;
+        return 1;
+    }
+    
+    vector<Entrant> entrants;
+    for (int i = argi; i < argc; i++) {
+        Race race;
+        try {
+            race.load(argv[i]);
+        } catch (GameExceptionRef exc) {
+            cerr << GameExceptionString(exc) << endl;
+            return 1;
+        }
+        
+        ifstream file(argv[i]);
+        ostringstream code;
+        code << file.rdbuf();
+        
+        Entrant entrant;
+        entrant.name = race.name;
+        entrant.code = code.str();
+        entrants.push_back(entrant);
+    }
+    
+    if (!options.seed) {
+        options.seed = GameRandomSeed();
+        cerr << "Seed: " << options.seed << endl;
+    }
+    
+    vector<Group> groups;
+    vector<Job>   jobs;
+    schedule(options, entrants.size(), groups, jobs);
+    
+    int listenFd = listenOn(options.listen);
+    if (listenFd < 0) {
+        cerr << "Listen failed: " << options.listen << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    
+    string host, port;
+    splitAddress(options.listen, host, port);
+    
+    vector<pid_t> children;
+    for (size_t i = 0; i < options.local; i++) {
+        pid_t child = fork();
+        if (!child) {
+            close(listenFd);
+            _exit(work("127.0.0.1:" + port));
+        }
+        
+        if (child > 0)
+            children.push_back(child);
+    }
+    
+    GameHeatmap heatmap;
+    bool finished = coordinate(listenFd, options, entrants, groups, jobs, heatmap);
+    close(listenFd);
+    
+    for (pid_t child : children) {
+        if (!finished)
+            kill(child, SIGTERM);
+        waitpid(child, nullptr, 0);
+    }
+    
+    if (!finished)
+        return 1;
+    
+    report(options, entrants, groups, jobs);
+    
+    if (options.heatmap.length()) {
+        bool text = options.heatmap.length() > 4 && options.heatmap.substr(options.heatmap.length() - 4) == ".txt";
+        
+        FILE *file = fopen(options.heatmap.c_str(), text ? "w" : "wb");
+        if (!file) {
+            cerr << "Write failed: " << options.heatmap << endl;
+            return 1;
+        }
+        
+        heatmap.write(file, !text);
+        fclose(file);
+    }
+    
+    return 0;
+}
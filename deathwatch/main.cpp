@@ -0,0 +1,180 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+#include "game.hpp"
+#include "spectator.hpp"
+
+#if UI_USE_ANSI
+#include "ansiui.hpp"
+#else
+#include "ncui.hpp"
+#endif
+
+using namespace std;
+
+
+typedef struct Board {
+    int32_t        move   = 0;
+    int32_t        width  = 0;
+    int32_t        height = 0;
+    vector<string> names;
+    bool           ended  = false;
+} Board;
+
+
+static void usage() {
+    cerr << "Usage: deathwatch <port | host:port | socket path>" << endl
+         << "Watches a game run with death -w. Press q to quit." << endl;
+}
+
+// Reads a T from a frame, refusing to step past its end.
+template <typename T>
+static bool get(const char *&data, const char *end, T &value) {
+    if (end - data < (ptrdiff_t)sizeof(value))
+        return false;
+    
+    memcpy(&value, data, sizeof(value));
+    data += sizeof(value);
+    return true;
+}
+
+static void drawSquare(UIDisplay &display, Board &board, int32_t x, int32_t y, RaceID race) {
+    if (x < 0 || y < 0 || x >= board.width || y >= board.height ||
+        x >= display.getWidth() || y >= display.getHeight() - 1)
+        return;
+    
+    if (race == RaceIDNone)
+        display.putChar(x, y, ' ');
+    else
+        display.putChar(x, y, CellCharacter | UIAttrForColor(UIColorForIndex(race)));
+}
+
+static void drawSquares(UIDisplay &display, Board &board, const char *data, const char *end) {
+    uint32_t count = 0;
+    if (!get(data, end, count))
+        return;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t  x = 0, y = 0;
+        uint16_t race = 0;
+        if (!get(data, end, x) || !get(data, end, y) || !get(data, end, race))
+            return;
+        
+        drawSquare(display, board, x, y, race);
+    }
+}
+
+static void drawFrame(UIDisplay &display, Board &board, char type, const char *data, const char *end) {
+    if (!get(data, end, board.move))
+        return;
+    
+    if (type == GameFrameKey) {
+        uint16_t races = 0;
+        if (!get(data, end, board.width) || !get(data, end, board.height) || !get(data, end, races))
+            return;
+        
+        board.names.assign(races, string());
+        for (string &name : board.names) {
+            uint8_t length = 0;
+            if (!get(data, end, length) || end - data < length)
+                return;
+            
+            name.assign(data, length);
+            data += length;
+        }
+        
+        for (int y = 0; y < min(board.height, display.getHeight()); y++)
+            for (int x = 0; x < min(board.width, display.getWidth()); x++)
+                drawSquare(display, board, x, y, RaceIDNone);
+        
+        drawSquares(display, board, data, end);
+    } else if (type == GameFrameDelta)
+        drawSquares(display, board, data, end);
+    else if (type == GameFrameEnd)
+        board.ended = true;
+}
+
+static void drawStatus(UIDisplay &display, Board &board, const string &state) {
+    int y = min(board.height, display.getHeight() - 1);
+    
+    string status = "Move " + to_string(board.move) + " | " + state + " |";
+    for (string &name : board.names)
+        status += " " + name;
+    
+    display.eraseLine(y);
+    display.putString(0, y, status.substr(0, display.getWidth()).c_str());
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc != 2) {
+        usage();
+        return 1;
+    }
+    
+    int fd;
+    try {
+        fd = GameSpectatorConnect(argv[1]);
+    } catch (GameExceptionRef exc) {
+        cerr << GameExceptionString(exc) << endl;
+        return 1;
+    }
+    
+    UIInit();
+    atexit(UIQuit);
+    
+    UIDisplay display(0, 0, -1, -1);
+    
+    Board  board;
+    string input;
+    string state = "waiting";
+    
+    drawStatus(display, board, state);
+    
+    while (UIReadKey() != 'q') {
+        pollfd watched[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+        if (poll(watched, fd >= 0 ? 2 : 1, -1) <= 0 || !(watched[1].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+        
+        char    buffer[1 << 16];
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        
+        if (size <= 0) {
+            close(fd);
+            fd = -1;
+            state = board.ended ? "finished" : "disconnected";
+        } else
+            input.append(buffer, size);
+        
+        size_t offset = 0;
+        while (input.size() - offset >= 5) {
+            const char *header = input.data() + offset;
+            const char *end    = input.data() + input.size();
+            uint8_t     type   = 0;
+            uint32_t    length = 0;
+            get(header, end, type);
+            get(header, end, length);
+            
+            if ((size_t)(end - header) < length)
+                break;
+            
+            drawFrame(display, board, type, header, header + length);
+            offset += 5 + length;
+            
+            if (fd >= 0)
+                state = board.ended ? "finished" : "live";
+        }
+        input.erase(0, offset);
+        
+        drawStatus(display, board, state);
+    }
+    
+    if (fd >= 0)
+        close(fd);
+    
+    return 0;
+}